@@ -21,6 +21,11 @@
 */
 #include "FF_WebServer.hpp"
 #include <StreamString.h>
+#include <memory>
+#include <algorithm>
+#ifdef FF_EMBED_ASSETS
+	#include "FF_WebServerAssets.h"							// Generated by makeassets.py
+#endif
 
 #define XQUOTE(x) #x
 #define QUOTE(x) XQUOTE(x)
@@ -35,6 +40,45 @@ const char Page_Restart[] PROGMEM = R"=====(
 Please Wait....Configuring and Restarting.
 )=====";
 
+// Compute FNV-1a hash of a buffer
+static uint32_t bufferHash(const char *data, const size_t len, uint32_t hash = 2166136261UL) {
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (uint8_t) data[i]) * 16777619UL;
+	}
+	return hash;
+}
+
+// Compute djb2 hash of a buffer (independent of bufferHash(), used to check its collisions)
+static uint32_t bufferCheck(const char *data, const size_t len) {
+	uint32_t hash = 5381;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash * 33) ^ (uint8_t) data[i];
+	}
+	return hash;
+}
+
+// Known file extensions and their content type (unknown ones are sent as text/plain)
+static const struct {
+	const char *extension;
+	const char *contentType;
+} contentTypes[] = {
+	{".htm", "text/html"},
+	{".html", "text/html"},
+	{".css", "text/css"},
+	{".js", "application/javascript"},
+	{".json", "application/json"},
+	{".png", "image/png"},
+	{".gif", "image/gif"},
+	{".jpg", "image/jpeg"},
+	{".ico", "image/x-icon"},
+	{".xml", "text/xml"},
+	{".pdf", "application/x-pdf"},
+	{".zip", "application/x-zip"},
+	{".gz", "application/x-gzip"},
+	{"", "text/plain"}										// Should be last
+};
+#define CONTENT_TYPE_COUNT (sizeof(contentTypes) / sizeof(contentTypes[0]))
+
 // ----- Trace -----
 extern trace_declare();
 
@@ -55,6 +99,7 @@ void AsyncFFWebServer::error404(AsyncWebServerRequest *request) {
 			return;
 		}
 	}
+	metricsResponse(404, 12);
 	request->send(404, "text/plain", "FileNotFound");
 }
 
@@ -390,18 +435,20 @@ void AsyncFFWebServer::mqttPublishRaw (const char *topic, const char *value, boo
 // Called each time system or user config is changed
 void AsyncFFWebServer::loadConfig(void) {
 	if (FF_WebServer.traceFlag) trace_info_P("Load config", NULL);
-	load_user_config("MQTTHost", configMQTT_Host);
-	load_user_config("MQTTPass", configMQTT_Pass);
-	load_user_config("MQTTPort", configMQTT_Port);
-	load_user_config("MQTTTopic", configMQTT_Topic);
-	load_user_config("MQTTCommandTopic", configMQTT_CommandTopic);
-	load_user_config("MQTTUser", configMQTT_User);
-	load_user_config("MQTTClientID", configMQTT_ClientID);
-	load_user_config("MQTTInterval", configMQTT_Interval);
+	load_user_config(FF_BUILTIN_CONFIG_KEYS, FF_BUILTIN_CONFIG_COUNT, &builtinConfig);
+	configMQTT_Host = builtinConfig.MQTTHost;
+	configMQTT_Pass = builtinConfig.MQTTPass;
+	configMQTT_Port = builtinConfig.MQTTPort;
+	configMQTT_Topic = builtinConfig.MQTTTopic;
+	configMQTT_CommandTopic = builtinConfig.MQTTCommandTopic;
+	configMQTT_User = builtinConfig.MQTTUser;
+	configMQTT_ClientID = builtinConfig.MQTTClientID;
+	configMQTT_Interval = builtinConfig.MQTTInterval;
 	#ifdef FF_TRACE_USE_SYSLOG
-		load_user_config("SyslogServer", syslogServer);
-		load_user_config("SyslogPort", syslogPort);
+		syslogServer = builtinConfig.SyslogServer;
+		syslogPort = builtinConfig.SyslogPort;
 	#endif
+	parseRateLimits(builtinConfig.RateLimits);
 }
 
 // Called each time system or user config is changed
@@ -486,6 +533,8 @@ String AsyncFFWebServer::formatBytes(size_t bytes) {
 String AsyncFFWebServer::standardHelpCmd() {
 	return String(PSTR("vars -> dump standard variables\r\n" 
 		"user -> dump user variables\r\n"
+		"metrics -> dump web server request metrics\r\n"
+		"cfgbench -> compare JSON and MessagePack configuration parsing\r\n"
 		"debug -> toggle debug flag\r\n"
 		"trace -> toggle trace flag\r\n"
 		"wdt -> toggle watchdog flag\r\n"));
@@ -515,6 +564,7 @@ void AsyncFFWebServer::begin(FS* fs, const char *version) {
 		trace_register((void (*)(traceLevel_t, const char*, uint16_t, const char*, const char*))&AsyncFFWebServer::defaultTraceCallback);
 	#endif
 
+	readUserConfigFile();									// Load user config cache
 	loadConfig();
 
 	if (!load_config()) { // Try to load configuration from file system
@@ -554,7 +604,9 @@ void AsyncFFWebServer::begin(FS* fs, const char *version) {
 
 	if ((configMQTT_ClientID == "") || (configMQTT_ClientID.startsWith("ESP_") && strcmp(configMQTT_ClientID.c_str(), tempBuffer))) {
 		configMQTT_ClientID = tempBuffer;
-		FF_WebServer.save_user_config("MQTTClientID", configMQTT_ClientID);
+		beginUserConfigTransaction();
+		save_user_config("MQTTClientID", configMQTT_ClientID);
+		commitUserConfigTransaction();
 	}
 
 	WiFi.hostname(_config.deviceName.c_str());
@@ -683,9 +735,22 @@ void AsyncFFWebServer::begin(FS* fs, const char *version) {
 		DEBUG_VERBOSE_P("FS File: %s, size: %s", fileName.c_str(), formatBytes(fileSize).c_str());
 	}
 #endif // DEBUG_FF_WEBSERVER
+	// Remove temporary files of uploads interrupted by a reset
+	for (uint8_t slot = 0; slot < FF_UPLOAD_CONTEXTS; slot++) {
+		char tempPath[sizeof(uploads[slot].tempPath)];
+		snprintf_P(tempPath, sizeof(tempPath), PSTR("/upload%u.tmp"), slot);
+		_fs->remove(tempPath);
+	}
+	buildFileIndex();
 	_secondTk.attach(1.0f, (void (*) (void*)) &AsyncFFWebServer::s_secondTick, static_cast<void*>(this)); // Task to run periodic things every second
 
 	AsyncWebServer::begin();								// Start underlying AsyncWebServer class
+	// Replace AsyncWebServer client handler to supervise connections
+	memset(connections, 0, sizeof(connections));
+	memset(connectionCloses, 0, sizeof(connectionCloses));
+	_server.onClient([this](void *arg, AsyncClient *client) {
+		this->acceptConnection(client);
+	}, this);
 	serverInit(); // Configure and start Web server
 
 	#ifndef DISABLE_MDNS
@@ -702,34 +767,249 @@ void AsyncFFWebServer::begin(FS* fs, const char *version) {
 	DEBUG_VERBOSE_P("END Setup");
 }
 
-//	Load config.json file
-bool AsyncFFWebServer::load_config() {
-	File configFile = _fs->open(CONFIG_FILE, "r");
+// Small buffered reader, letting ArduinoJson parse a file without reading it byte by byte,
+//	nor loading it fully in memory. Free heap is sampled at each buffer refill, to get its minimum during parse
+class FF_FileReader {
+public:
+	FF_FileReader(File &file) : _file(file) {
+		minFreeHeap = ESP.getFreeHeap();
+	}
+
+	uint32_t minFreeHeap;									// Minimum free heap seen while reading
+
+	int read() {
+		if (_pos >= _len) {
+			uint32_t freeHeap = ESP.getFreeHeap();
+			if (freeHeap < minFreeHeap) {
+				minFreeHeap = freeHeap;
+			}
+			_len = _file.read(_buffer, sizeof(_buffer));
+			_pos = 0;
+			if (!_len) {
+				return -1;
+			}
+		}
+		return _buffer[_pos++];
+	}
+
+	size_t readBytes(char *buffer, size_t length) {
+		size_t count = 0;
+		while (count < length) {
+			int c = read();
+			if (c < 0) {
+				break;
+			}
+			buffer[count++] = (char) c;
+		}
+		return count;
+	}
+
+private:
+	File &_file;
+	uint8_t _buffer[64];
+	size_t _pos = 0;
+	size_t _len = 0;
+};
+
+// Keep track of peak heap used while parsing a configuration file (minFreeHeap being sampled during parse)
+void AsyncFFWebServer::updateConfigLoadHeap(uint32_t heapBefore, uint32_t minFreeHeap) {
+	uint32_t heapNow = std::min(ESP.getFreeHeap(), minFreeHeap);
+	if (heapBefore > heapNow && (heapBefore - heapNow) > configLoadPeakHeap) {
+		configLoadPeakHeap = heapBefore - heapNow;
+	}
+}
+
+// Return name of binary version of a configuration file (.json replaced by .mpk)
+String AsyncFFWebServer::binaryConfigName(const char *fileName) {
+	String binaryName = fileName;
+	binaryName.replace(PSTR(".json"), PSTR(CONFIG_BINARY_EXTENSION));
+	return binaryName;
+}
+
+// Check if a path is one of configuration files
+bool AsyncFFWebServer::isConfigFile(const String &path) {
+	return path == CONFIG_FILE || path == USER_CONFIG_FILE || path == SECRET_FILE;
+}
+
+// Check if a configuration file exists (in JSON or binary format)
+bool AsyncFFWebServer::configFileExists(const char *fileName) {
+	#ifdef FF_CONFIG_USE_MSGPACK
+		if (_fs->exists(binaryConfigName(fileName))) {
+			return true;
+		}
+	#endif
+	return _fs->exists(fileName);
+}
+
+// Remove a configuration file (in JSON and binary format)
+void AsyncFFWebServer::removeConfigFile(const char *fileName) {
+	#ifdef FF_CONFIG_USE_MSGPACK
+		String binaryName = binaryConfigName(fileName);
+		if (_fs->exists(binaryName)) {
+			_fs->remove(binaryName);
+		}
+	#endif
+	if (_fs->exists(fileName)) {
+		_fs->remove(fileName);
+	}
+	updateFileIndex(fileName);
+}
+
+/*
+
+	Read a configuration file into a JSON document
+
+	When FF_CONFIG_USE_MSGPACK is defined, file is stored in MessagePack format,
+		except if a JSON file exists (old one, or uploaded through /edit).
+		In this case, JSON file is read (without filter) and converted into MessagePack.
+
+*/
+bool AsyncFFWebServer::readConfigFile(const char *fileName, JsonDocument &jsonDoc, const JsonDocument *filter) {
+	bool binary = false;
+	File configFile;
+
+	#ifdef FF_CONFIG_USE_MSGPACK
+		binary = !_fs->exists(fileName);
+		if (binary) {
+			configFile = _fs->open(binaryConfigName(fileName), "r");
+		} else {
+			DEBUG_VERBOSE_P("Converting %s to binary format", fileName);
+			filter = NULL;									// Keep all keys in converted file
+		}
+	#endif
+	if (!binary) {
+		configFile = _fs->open(fileName, "r");
+	}
 	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s", CONFIG_FILE);
+		DEBUG_ERROR_P("Failed to open %s", fileName);
 		return false;
 	}
 
-	size_t size = configFile.size();
-	/*if (size > 1024) {
-	DEBUG_VERBOSE_P("Config file size is too large");
+	DEBUG_VERBOSE_P("%s file size: %d bytes", fileName, configFile.size());
+	uint32_t heapBefore = ESP.getFreeHeap();
+	FF_FileReader reader(configFile);
+	DeserializationError error;
+	if (binary) {
+		error = filter ? deserializeMsgPack(jsonDoc, reader, DeserializationOption::Filter(*filter)) : deserializeMsgPack(jsonDoc, reader);
+	} else {
+		error = filter ? deserializeJson(jsonDoc, reader, DeserializationOption::Filter(*filter)) : deserializeJson(jsonDoc, reader);
+	}
+	updateConfigLoadHeap(heapBefore, reader.minFreeHeap);
 	configFile.close();
-	return false;
-	}*/
+	if (error) {
+		DEBUG_ERROR_P("Failed to parse %s. Error: %s", fileName, error.c_str());
+		return false;
+	}
 
-	// Allocate a buffer to store contents of the file.
-	std::unique_ptr<char[]> buf(new char[size]);
+	#ifdef FF_CONFIG_USE_MSGPACK
+		if (!binary) {
+			writeConfigFile(fileName, jsonDoc);			// Also removes JSON file
+		}
+	#endif
+	return true;
+}
+
+// Write a JSON document into a configuration file (in MessagePack format if FF_CONFIG_USE_MSGPACK is defined)
+bool AsyncFFWebServer::writeConfigFile(const char *fileName, const JsonDocument &jsonDoc) {
+	#ifdef FF_CONFIG_USE_MSGPACK
+		File configFile = _fs->open(binaryConfigName(fileName), "w");
+	#else
+		File configFile = _fs->open(fileName, "w");
+	#endif
+	if (!configFile) {
+		DEBUG_ERROR_P("Failed to open %s for writing", fileName);
+		return false;
+	}
 
-	// We don't use String here because ArduinoJson library requires the input
-	// buffer to be mutable. If you don't use ArduinoJson, you may as well
-	// use configFile.readString instead.
-	configFile.readBytes(buf.get(), size);
+	#ifdef FF_CONFIG_USE_MSGPACK
+		serializeMsgPack(jsonDoc, configFile);
+	#else
+		serializeJson(jsonDoc, configFile);
+	#endif
+	configFile.flush();
 	configFile.close();
-	DEBUG_VERBOSE_P("JSON file size: %d bytes", size);
+	#ifdef FF_CONFIG_USE_MSGPACK
+		// Remove JSON version, as it would be read instead of binary one
+		if (_fs->exists(fileName)) {
+			_fs->remove(fileName);
+		}
+	#endif
+	updateFileIndex(fileName);
+	return true;
+}
+
+// Time parsing of a configuration file, in JSON or MessagePack format
+unsigned long AsyncFFWebServer::benchmarkConfigParse(const char *fileName, const bool binary, size_t &fileSize) {
+	const int loops = 10;
+	unsigned long totalTime = 0;
+
+	fileSize = 0;
+	for (int i = 0; i < loops; i++) {
+		unsigned long startTime = micros();
+		File configFile = _fs->open(fileName, "r");
+		if (!configFile) {
+			return 0;
+		}
+		fileSize = configFile.size();
+		JsonDocument jsonDoc;
+		FF_FileReader reader(configFile);
+		if (binary) {
+			deserializeMsgPack(jsonDoc, reader);
+		} else {
+			deserializeJson(jsonDoc, reader);
+		}
+		configFile.close();
+		totalTime += micros() - startTime;
+		yield();
+	}
+	return totalTime / loops;
+}
+
+// Compare JSON and MessagePack parsing time and size of each configuration file
+void AsyncFFWebServer::benchmarkConfigFormats(void) {
+	const char *fileNames[] = {CONFIG_FILE, USER_CONFIG_FILE, SECRET_FILE};
+	const char jsonBench[] = "/cfgbench.json";
+	const char binaryBench[] = "/cfgbench" CONFIG_BINARY_EXTENSION;
+
+	for (size_t i = 0; i < sizeof(fileNames) / sizeof(fileNames[0]); i++) {
+		JsonDocument jsonDoc;
+		if (!readConfigFile(fileNames[i], jsonDoc, NULL)) {
+			continue;
+		}
+		// Write same content in both formats
+		File benchFile = _fs->open(jsonBench, "w");
+		serializeJson(jsonDoc, benchFile);
+		benchFile.close();
+		benchFile = _fs->open(binaryBench, "w");
+		serializeMsgPack(jsonDoc, benchFile);
+		benchFile.close();
+		size_t jsonSize, binarySize;
+		unsigned long jsonTime = benchmarkConfigParse(jsonBench, false, jsonSize);
+		unsigned long binaryTime = benchmarkConfigParse(binaryBench, true, binarySize);
+		trace_info_P("%s: JSON %u bytes in %lu us, MessagePack %u bytes in %lu us", fileNames[i], jsonSize, jsonTime, binarySize, binaryTime);
+		_fs->remove(jsonBench);
+		_fs->remove(binaryBench);
+	}
+}
+
+//	Load config.json file
+bool AsyncFFWebServer::load_config() {
+	// Only keep keys we're using
+	JsonDocument filter;
+	filter["ssid"] = true;
+	filter["pass"] = true;
+	filter["ip"] = true;
+	filter["netmask"] = true;
+	filter["gateway"] = true;
+	filter["dns"] = true;
+	filter["dhcp"] = true;
+	filter["ntp"] = true;
+	filter["NTPperiod"] = true;
+	filter["timeZone"] = true;
+	filter["daylight"] = true;
+	filter["deviceName"] = true;
 	JsonDocument jsonDoc;
-	auto error = deserializeJson(jsonDoc, buf.get());
-	if (error) {
-		DEBUG_ERROR_P("Failed to parse %s. Error: %s", CONFIG_FILE, error.c_str());
+	if (!readConfigFile(CONFIG_FILE, jsonDoc, &filter)) {
 		return false;
 	}
 
@@ -820,22 +1100,12 @@ bool AsyncFFWebServer::save_config() {
 	jsonDoc["daylight"] = _config.daylight;
 	jsonDoc["deviceName"] = _config.deviceName;
 
-	File configFile = _fs->open(CONFIG_FILE, "w");
-	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s for writing", CONFIG_FILE);
-		configFile.close();
-		return false;
-	}
-
 	#ifdef DEBUG_FF_WEBSERVER
 		String temp;
 		serializeJsonPretty(jsonDoc, temp);
 		DEBUG_VERBOSE_P("Saved config: %s", temp.c_str());
 	#endif
-	serializeJson(jsonDoc, configFile);
-	configFile.flush();
-	configFile.close();
-	return true;
+	return writeConfigFile(CONFIG_FILE, jsonDoc);
 }
 
 /*!
@@ -848,13 +1118,8 @@ bool AsyncFFWebServer::save_config() {
 */
 void AsyncFFWebServer::clearConfig(bool reset)
 {
-	if (_fs->exists(CONFIG_FILE)) {
-		_fs->remove(CONFIG_FILE);
-	}
-
-	if (_fs->exists(SECRET_FILE)) {
-		_fs->remove(SECRET_FILE);
-	}
+	removeConfigFile(CONFIG_FILE);
+	removeConfigFile(SECRET_FILE);
 
 	if (reset) {
 		_fs->end();
@@ -862,46 +1127,77 @@ void AsyncFFWebServer::clearConfig(bool reset)
 	}
 }
 
+// Read userconfig.json into user config cache
+bool AsyncFFWebServer::readUserConfigFile(void) {
+	userConfigDoc.clear();
+	userConfigDoc.to<JsonObject>();
+	userConfigLoaded = false;
+	userConfigValid = false;
+	userConfigDirty = false;
+	userConfigChanges.clear();
+	userConfigFileReads++;
+
+	// All keys are kept, as cache should answer any load_user_config call
+	if (!readConfigFile(USER_CONFIG_FILE, userConfigDoc, NULL)) {
+		userConfigDoc.clear();
+		userConfigDoc.to<JsonObject>();
+		// A missing file is an empty config, an unreadable one (i.e. low memory) is read again at next access
+		userConfigLoaded = !configFileExists(USER_CONFIG_FILE);
+		return false;
+	}
+	userConfigLoaded = true;
+
+	#ifdef DEBUG_FF_WEBSERVER
+		String temp;
+		serializeJsonPretty(userConfigDoc, temp);
+		DEBUG_VERBOSE_P("User config: %s", temp.c_str());
+	#endif
+	userConfigValid = true;
+	return true;
+}
+
+// Write user config cache to userconfig.json, if modified
+bool AsyncFFWebServer::writeUserConfigFile(void) {
+	if (!userConfigDirty) {
+		return true;
+	}
+
+	#ifdef DEBUG_FF_WEBSERVER
+		String temp;
+		serializeJsonPretty(userConfigDoc, temp);
+		DEBUG_VERBOSE_P("Save user config %s", temp.c_str());
+	#endif
+	if (!writeConfigFile(USER_CONFIG_FILE, userConfigDoc)) {
+		return false;
+	}
+	userConfigFileWrites++;
+	userConfigDirty = false;
+	userConfigValid = true;
+	return true;
+}
+
 /*!
 
 	Load an user's configuration String
 
+	Value is read from user config cache, loaded once from userconfig.json.
+
 	\param[in]	name: item name to return
 	\param[out]	value: returned (String) value
 	\return	false if error detected, true else
 
 */
 bool AsyncFFWebServer::load_user_config(String name, String &value) {
-	File configFile = _fs->open(USER_CONFIG_FILE, "r");
-	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s", USER_CONFIG_FILE);
-		return false;
+	if (userConfigLoaded) {
+		userConfigCacheHits++;
+	} else {
+		readUserConfigFile();
 	}
-
-	size_t size = configFile.size();
-	/*if (size > 1024) {
-	DEBUG_ERROR_P("Config file size is too large");
-	configFile.close();
-	return false;
-	}*/
-
-	// Allocate a buffer to store contents of the file.
-	std::unique_ptr<char[]> buf(new char[size]);
-
-	// We don't use String here because ArduinoJson library requires the input
-	// buffer to be mutable. If you don't use ArduinoJson, you may as well
-	// use configFile.readString instead.
-	configFile.readBytes(buf.get(), size);
-	configFile.close();
-	DEBUG_VERBOSE_P("JSON file size: %d bytes", size);
-	JsonDocument jsonDoc;
-	auto error = deserializeJson(jsonDoc, buf.get());
-	if (error) {
-		DEBUG_ERROR_P("Failed to parse %s. Error: %s", USER_CONFIG_FILE, error.c_str());
+	if (!userConfigValid) {
 		return false;
 	}
 
-	value = jsonDoc[name].as<const char*>();
+	value = userConfigDoc[name].as<const char*>();
 
 	#ifdef DEBUG_FF_WEBSERVER
 		DEBUG_VERBOSE_P("User config: %s=%s", name.c_str(), value.c_str());
@@ -911,74 +1207,301 @@ bool AsyncFFWebServer::load_user_config(String name, String &value) {
 
 // Save one user config item (String)
 bool AsyncFFWebServer::save_user_config(String name, String value) {
-	//add logic to test and create if non
 	DEBUG_VERBOSE_P("%s: %s", name.c_str(), value.c_str());
 
-	File configFile;
-	if (!_fs->exists(USER_CONFIG_FILE)) {
-		configFile = _fs->open(USER_CONFIG_FILE, "w");
-		if (!configFile) {
-			DEBUG_ERROR_P("Failed to open %s for writing", USER_CONFIG_FILE);
-			configFile.close();
-			return false;
-		}
-		//create blank json file
-		DEBUG_VERBOSE_P("Creating user %s for writing", USER_CONFIG_FILE);
-		configFile.print("{}");
-		configFile.close();
+	if (!userConfigLoaded) {
+		readUserConfigFile();
 	}
-	//get existing json file
-	configFile = _fs->open(USER_CONFIG_FILE, "r");
-	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s", USER_CONFIG_FILE);
+	// Don't overwrite an existing file that can't be parsed
+	if (!userConfigValid && configFileExists(USER_CONFIG_FILE)) {
+		DEBUG_ERROR_P("Can't save %s into unreadable %s", name.c_str(), USER_CONFIG_FILE);
 		return false;
 	}
-	size_t size = configFile.size();
-	/*if (size > 1024) {
-	DEBUG_VERBOSE_P("Config file size is too large");
-	configFile.close();
-	return false;
-	}*/
 
-	// Allocate a buffer to store contents of the file.
-	std::unique_ptr<char[]> buf(new char[size]);
+	// Nothing to write if value didn't change
+	JsonVariant item = userConfigDoc[name];
+	if (userConfigValid && item.is<const char*>() && value == item.as<const char*>()) {
+		return true;
+	}
 
-	// We don't use String here because ArduinoJson library requires the input
-	// buffer to be mutable. If you don't use ArduinoJson, you may as well
-	// use configFile.readString instead.
-	configFile.readBytes(buf.get(), size);
-	configFile.close();
-	DEBUG_VERBOSE_P("Read JSON file size: %d bytes", size);
-	JsonDocument jsonDoc;
-	auto error = deserializeJson(jsonDoc, buf.get());
+	// Keep value before first change, to be given to change callback
+	if (userConfigChanges[name].isNull()) {
+		userConfigChanges[name] = item.isNull() ? String() : item.as<String>();
+	}
+	userConfigDoc[name] = value;
+	userConfigDirty = true;
+	// Write will be done at commit time if a transaction is opened
+	if (userConfigTransactionDepth) {
+		return true;
+	}
+	// Direct saves don't call change callbacks, only transactions do
+	userConfigChanges.remove(name);
+	return writeUserConfigFile();
+}
 
-	if (error) {
-		DEBUG_ERROR_P("Failed to parse %s. Error: %s", USER_CONFIG_FILE, error.c_str());
+// Call change callbacks for each key modified since last call
+void AsyncFFWebServer::notifyUserConfigChanges(void) {
+	// Changes committed by callbacks are signaled by outer call, once current ones are done
+	if (userConfigNotifying) {
+		return;
+	}
+	// Don't signal changes done before end of begin(), callbacks will be called there
+	if (!serverStarted) {
+		userConfigChanges.clear();
+		return;
+	}
+	userConfigNotifying = true;
+	// Limit number of rounds, in case callbacks keep changing values
+	for (uint8_t round = 0; round < 4 && userConfigChanges.size(); round++) {
+		// Work on a copy, as callbacks may save other values
+		JsonDocument changes = userConfigChanges;
+		userConfigChanges.clear();
+		notifyUserConfigKeys(changes);
+	}
+	userConfigChanges.clear();
+	userConfigNotifying = false;
+}
+
+// Call change callbacks for each key of a change list (key: old value)
+void AsyncFFWebServer::notifyUserConfigKeys(const JsonDocument &changes) {
+	bool changed = false;
+	bool builtinChanged = false;
+	for (JsonPairConst change : changes.as<JsonObjectConst>()) {
+		const char *key = change.key().c_str();
+		String oldValue = change.value().as<String>();
+		String newValue = userConfigDoc[key].as<String>();
+		// Ignore keys set back to their initial value
+		if (oldValue == newValue) {
+			continue;
+		}
+		changed = true;
+		if (findUserConfigKey(FF_BUILTIN_CONFIG_KEYS, FF_BUILTIN_CONFIG_COUNT, key) >= 0) {
+			builtinChanged = true;
+		}
+		DEBUG_VERBOSE_P("%s changed from %s to %s", key, oldValue.c_str(), newValue.c_str());
+		if (configKeyChangedCallback) {
+			configKeyChangedCallback(key, oldValue.c_str(), newValue.c_str());
+		}
+	}
+	// Reload internal config only if one of its keys changed
+	if (builtinChanged) {
+		loadConfig();
+	}
+	if (changed) {
+		loadUserConfig();
+	}
+}
+
+/*!
+
+	Start an user's configuration transaction
+
+	All save_user_config calls done until commitUserConfigTransaction() only update memory.
+		Transactions can be nested, file being written by the outermost commit.
+
+	\param	None
+	\return	None
+
+*/
+void AsyncFFWebServer::beginUserConfigTransaction(void) {
+	if (!userConfigLoaded) {
+		readUserConfigFile();
+	}
+	userConfigTransactionDepth++;
+}
+
+/*!
+
+	Commit an user's configuration transaction
+
+	Writes userconfig.json once, only if something changed since transaction start.
+		Change callbacks are then called for each modified key.
+
+	\param	None
+	\return	false if error detected, true else
+
+*/
+bool AsyncFFWebServer::commitUserConfigTransaction(void) {
+	if (userConfigTransactionDepth) {
+		userConfigTransactionDepth--;
+	}
+	if (userConfigTransactionDepth) {
+		return true;
+	}
+	// Signal changes only once they're written
+	if (!writeUserConfigFile()) {
+		userConfigChanges.clear();
 		return false;
+	}
+	notifyUserConfigChanges();
+	return true;
+}
+
+
+// Load one typed value from user config cache into a configuration structure
+bool AsyncFFWebServer::loadUserConfigValue(const ffConfigKey_t *key, void *values) {
+	uint8_t *value = (uint8_t *) values + key->offset;
+	JsonVariantConst item = userConfigDoc[key->name];
+	// Values saved by web pages are strings, while values set by hand may be numbers or booleans
+	const char *text = item.is<const char*>() ? item.as<const char*>() : NULL;
+
+	switch (key->type) {
+		case FF_CONFIG_STRING: {
+			size_t length;
+			if (text) {
+				length = strlcpy((char *) value, text, key->size);
+			} else {
+				String temp = item.isNull() ? String() : item.as<String>();
+				length = strlcpy((char *) value, temp.c_str(), key->size);
+			}
+			// Don't silently cut values longer than field (size set by maxlength or csize in userconfigui.json)
+			if (length >= key->size) {
+				DEBUG_ERROR_P("%s is %u chars long, only %u kept: increase its size in schema", key->name, length, key->size - 1);
+				return false;
+			}
+			break;
+		}
+		case FF_CONFIG_INT:
+			*(int *) value = text ? atoi(text) : item.as<int>();
+			break;
+		case FF_CONFIG_LONG:
+			*(long *) value = text ? atol(text) : item.as<long>();
+			break;
+		case FF_CONFIG_BOOL:
+			if (text) {
+				*(bool *) value = atoi(text) || !strcasecmp_P(text, PSTR("true")) || !strcasecmp_P(text, PSTR("on")) || !strcasecmp_P(text, PSTR("checked"));
+			} else {
+				*(bool *) value = item.as<bool>() || item.as<int>();
+			}
+			break;
+		case FF_CONFIG_FLOAT:
+			*(float *) value = text ? atof(text) : item.as<float>();
+			break;
+		case FF_CONFIG_IP: {
+			IPAddress ip;
+			if (!text || !ip.fromString(text)) {
+				ip = IPAddress((uint32_t) 0);
+			}
+			*(uint32_t *) value = (uint32_t) ip;
+			break;
+		}
+		default:
+			return false;
+	}
+	return true;
+}
+
+/*!
+
+	Load all user's configuration values described by a key table (generated by makeschema.py)
+
+	\param[in]	keys: key table (i.e. FF_USER_CONFIG_KEYS)
+	\param[in]	count: number of keys in table (i.e. FF_USER_CONFIG_COUNT)
+	\param[out]	values: configuration structure to fill (i.e. ffUserConfig_t)
+	\return	false if error detected, true else
+
+*/
+bool AsyncFFWebServer::load_user_config(const ffConfigKey_t *keys, const size_t count, void *values) {
+	if (userConfigLoaded) {
+		userConfigCacheHits++;
 	} else {
-		DEBUG_VERBOSE_P("Parse User config file");
+		readUserConfigFile();
+	}
+	bool result = userConfigValid;
+	for (size_t i = 0; i < count; i++) {
+		if (!loadUserConfigValue(&keys[i], values)) {
+			result = false;
+		}
 	}
+	return result;
+}
 
-	jsonDoc[name] = value;
+/*!
 
-	configFile = _fs->open(USER_CONFIG_FILE, "w");
-	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s for writing", USER_CONFIG_FILE);
-		configFile.close();
+	Load one user's configuration value described by a key table (generated by makeschema.py)
+
+	\param[in]	keys: key table (i.e. FF_USER_CONFIG_KEYS)
+	\param[in]	count: number of keys in table (i.e. FF_USER_CONFIG_COUNT)
+	\param[out]	values: configuration structure to update (i.e. ffUserConfig_t)
+	\param[in]	name: name of key to load
+	\return	false if error detected or key unknown, true else
+
+*/
+bool AsyncFFWebServer::load_user_config(const ffConfigKey_t *keys, const size_t count, void *values, const char *name) {
+	int index = findUserConfigKey(keys, count, name);
+	if (index < 0) {
 		return false;
 	}
+	if (userConfigLoaded) {
+		userConfigCacheHits++;
+	} else {
+		readUserConfigFile();
+	}
+	return loadUserConfigValue(&keys[index], values) && userConfigValid;
+}
 
-	#ifdef DEBUG_FF_WEBSERVER
-		String temp;
-		serializeJsonPretty(jsonDoc, temp);
-		DEBUG_VERBOSE_P("Save user config %s", temp.c_str());
-	#endif
-	serializeJson(jsonDoc, configFile);
-	configFile.flush();
-	configFile.close();
-	return true;
+/*!
+
+	Save all user's configuration values described by a key table (generated by makeschema.py)
+
+	File is written once, only if a value changed.
+
+	\param[in]	keys: key table (i.e. FF_USER_CONFIG_KEYS)
+	\param[in]	count: number of keys in table (i.e. FF_USER_CONFIG_COUNT)
+	\param[in]	values: configuration structure to save (i.e. ffUserConfig_t)
+	\return	false if error detected, true else
+
+*/
+bool AsyncFFWebServer::save_user_config(const ffConfigKey_t *keys, const size_t count, const void *values) {
+	bool status = true;
+
+	beginUserConfigTransaction();
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *value = (const uint8_t *) values + keys[i].offset;
+		switch (keys[i].type) {
+			case FF_CONFIG_STRING:
+				status &= save_user_config(keys[i].name, String((const char *) value));
+				break;
+			case FF_CONFIG_INT:
+				status &= save_user_config(keys[i].name, *(const int *) value);
+				break;
+			case FF_CONFIG_LONG:
+				status &= save_user_config(keys[i].name, *(const long *) value);
+				break;
+			case FF_CONFIG_BOOL:
+				status &= save_user_config(keys[i].name, String(*(const bool *) value ? 1 : 0));
+				break;
+			case FF_CONFIG_FLOAT:
+				status &= save_user_config(keys[i].name, *(const float *) value);
+				break;
+			case FF_CONFIG_IP:
+				status &= save_user_config(keys[i].name, IPAddress(*(const uint32_t *) value).toString());
+				break;
+		}
+	}
+	status &= commitUserConfigTransaction();
+	return status;
 }
 
+/*!
+
+	Find a key in a key table (generated by makeschema.py)
+
+	\param[in]	keys: key table (i.e. FF_USER_CONFIG_KEYS)
+	\param[in]	count: number of keys in table (i.e. FF_USER_CONFIG_COUNT)
+	\param[in]	name: name of key to find
+	\return	index of key in table, -1 if not found
+
+*/
+int AsyncFFWebServer::findUserConfigKey(const ffConfigKey_t *keys, const size_t count, const char *name) {
+	uint32_t hash = ffConfigHash(name);
+	for (size_t i = 0; i < count; i++) {
+		if (keys[i].hash == hash && !strcmp(keys[i].name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
 
 /*!
 
@@ -989,9 +1512,8 @@ bool AsyncFFWebServer::save_user_config(String name, String value) {
 
 */
 void AsyncFFWebServer::clearUserConfig(bool reset) {
-	if (_fs->exists(USER_CONFIG_FILE)) {
-		_fs->remove(USER_CONFIG_FILE);
-	}
+	removeConfigFile(USER_CONFIG_FILE);
+	userConfigLoaded = false;
 
 	if (reset) {
 		_fs->end();
@@ -1065,44 +1587,16 @@ bool AsyncFFWebServer::save_user_config(String name, long value) {
 
 // Load secret file
 bool AsyncFFWebServer::loadHTTPAuth() {
-	File configFile = _fs->open(SECRET_FILE, "r");
-	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s", SECRET_FILE);
+	// Only keep keys we're using
+	JsonDocument filter;
+	filter["auth"] = true;
+	filter["user"] = true;
+	filter["pass"] = true;
+	JsonDocument jsonDoc;
+	if (!readConfigFile(SECRET_FILE, jsonDoc, &filter)) {
 		_httpAuth.auth = false;
 		_httpAuth.wwwUsername = "";
 		_httpAuth.wwwPassword = "";
-		configFile.close();
-		return false;
-	}
-
-	size_t size = configFile.size();
-	/*if (size > 256) {
-	DEBUG_VERBOSE_P("Secret file size is too large");
-	httpAuth.auth = false;
-	configFile.close();
-	return false;
-	}*/
-
-	// Allocate a buffer to store contents of the file.
-	std::unique_ptr<char[]> buf(new char[size]);
-
-	// We don't use String here because ArduinoJson library requires the input
-	// buffer to be mutable. If you don't use ArduinoJson, you may as well
-	// use configFile.readString instead.
-	configFile.readBytes(buf.get(), size);
-	configFile.close();
-	DEBUG_VERBOSE_P("JSON secret file size: %d bytes", size);
-	JsonDocument jsonDoc;
-	auto error = deserializeJson(jsonDoc, buf.get());
-
-	if (error) {
-		#ifdef DEBUG_FF_WEBSERVER
-			String temp;
-			serializeJsonPretty(jsonDoc, temp);
-			DEBUG_ERROR_P("Failed to parse %s. Error: %s", SECRET_FILE, error.c_str());
-			DEBUG_ERROR_P("Contents %s", temp.c_str());
-		#endif // DEBUG_FF_WEBSERVER
-		_httpAuth.auth = false;
 		return false;
 	}
 	#ifdef DEBUG_FF_WEBSERVER
@@ -1208,6 +1702,16 @@ void AsyncFFWebServer::handle(void) {
 		updateTimeFromNTP = false;
 	}
 
+	// Handle Wi-Fi scan requests
+	serviceWifiScan();
+
+	// Close stalled connections
+	serviceConnections();
+
+	// Publish changed bound values, then send changed values to /events clients
+	serviceBoundValues();
+	servicePushValues();
+
 	// Handle MQTT (re)connection
 	if (!mqttClient.connected()) {						// If MQTT is not connected
 		connectToMqtt();								// Connect to MQTT
@@ -1355,59 +1859,415 @@ void AsyncFFWebServer::onWiFiDisconnected(WiFiEventStationModeDisconnected data)
 	}
 }
 
+// State of a /list chunked response
+struct FF_FileList {
+	String root;											// Listed folder, ending with /
+	std::vector<Dir> dirs;									// Opened folders (more than one if recursive)
+	std::vector<String> prefixes;							// Name prefix of each opened folder, relative to root
+	uint32_t skip = 0;										// Entries still to skip (offset)
+	uint32_t remaining = 0;									// Maximum entries to send (limit), 0 for all
+	uint32_t count = 0;										// Entries already sent
+	bool recursive = false;									// List subfolders content
+	String text;											// Text being sent
+	size_t sent = 0;										// Bytes of text already sent
+	bool done = false;										// List has been closed
+};
+
 // Return file list
 void AsyncFFWebServer::handleFileList(AsyncWebServerRequest *request) {
 	if (!request->hasArg("dir")) {
-	    request->send(500, "text/plain", "BAD ARGS");
-	    return;
+		sendResponse(request, 500, "text/plain", "BAD ARGS");
+		return;
 	}
 
-	String path = request->arg("dir");
-	DEBUG_VERBOSE_P("handleFileList: %s", path.c_str());
-	Dir dir = _fs->openDir(path);
-	path = String();
-
-	String output = PSTR("[");
-	while (dir.next()) {
-		File entry = dir.openFile("r");
-		if (output != "[") {
-			output += PSTR(",");
-		}
-		bool isDir = false;
-		output += PSTR("{\"type\":\"");
-		if (isDir) {
-			output += PSTR("dir");
-		} else { 
-			output += PSTR("file");
+	std::shared_ptr<FF_FileList> list = std::make_shared<FF_FileList>();
+	list->root = request->arg("dir");
+	if (!list->root.endsWith("/")) {
+		list->root += "/";
+	}
+	if (request->hasArg("offset")) {
+		list->skip = request->arg("offset").toInt();
+	}
+	if (request->hasArg("limit")) {
+		list->remaining = request->arg("limit").toInt();
+	}
+	list->recursive = request->hasArg("recursive") && request->arg("recursive") != "0";
+	DEBUG_VERBOSE_P("handleFileList: %s", list->root.c_str());
+	list->dirs.push_back(_fs->openDir(list->root));
+	list->prefixes.push_back(String());
+	list->text = PSTR("[");
+
+	// Entries are read from directory while response is sent, without opening files
+	AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [this, list](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+		size_t len = 0;
+		while (len < maxLen) {
+			// Send current text first
+			if (list->sent < list->text.length()) {
+				size_t count = std::min(maxLen - len, list->text.length() - list->sent);
+				memcpy(buffer + len, list->text.c_str() + list->sent, count);
+				list->sent += count;
+				len += count;
+				continue;
+			}
+			if (list->done) {
+				break;
+			}
+			list->text = String();
+			list->sent = 0;
+			// Look for next entry
+			while (!list->dirs.empty()) {
+				if (!list->dirs.back().next()) {
+					list->dirs.pop_back();
+					list->prefixes.pop_back();
+					continue;
+				}
+				String name = list->prefixes.back() + list->dirs.back().fileName();
+				bool isDir = list->dirs.back().isDirectory();
+				size_t size = isDir ? 0 : list->dirs.back().fileSize();
+				if (isDir && list->recursive) {
+					list->dirs.push_back(_fs->openDir(list->root + name));
+					list->prefixes.push_back(name + "/");
+				}
+				if (list->skip) {
+					list->skip--;
+					continue;
+				}
+				#ifdef FF_CONFIG_USE_MSGPACK
+					// Show binary configuration files with their JSON name, as they're sent in JSON format
+					if (name.endsWith(CONFIG_BINARY_EXTENSION)) {
+						String jsonName = name;
+						jsonName.replace(PSTR(CONFIG_BINARY_EXTENSION), PSTR(".json"));
+						if (isConfigFile(list->root + jsonName)) {
+							name = jsonName;
+						}
+					}
+				#endif
+				char entry[48];
+				snprintf_P(entry, sizeof(entry), PSTR("%s{\"type\":\"%s\",\"name\":\""), list->count ? "," : "", isDir ? "dir" : "file");
+				list->text = entry;
+				list->text += name;
+				snprintf_P(entry, sizeof(entry), PSTR("\",\"size\":%u}"), size);
+				list->text += entry;
+				list->count++;
+				break;
+			}
+			// Close list when all entries are sent, or limit reached
+			if (list->dirs.empty() || (list->remaining && list->count >= list->remaining)) {
+				list->text += PSTR("]");
+				list->done = true;
+			}
 		}
-		output += PSTR("\",\"name\":\"")
-			+ String(entry.name())
-			+ PSTR("\"}");
-		entry.close();
+		return len;
+	});
+	// Chunked answer, length is not known yet
+	metricsResponse(200);
+	request->send(response);
+}
+
+// Send file system information
+void AsyncFFWebServer::handleFileSystemInfo(AsyncWebServerRequest *request) {
+	FSInfo info;
+	if (!_fs->info(info)) {
+		sendResponse(request, 500, "text/plain", "FS INFO FAILED");
+		return;
 	}
+	char output[160];
+	snprintf_P(output, sizeof(output), PSTR("{\"totalBytes\":%u,\"usedBytes\":%u,\"blockSize\":%u,\"pageSize\":%u,\"maxOpenFiles\":%u,\"maxPathLength\":%u}"),
+		info.totalBytes, info.usedBytes, info.blockSize, info.pageSize, info.maxOpenFiles, info.maxPathLength);
+	sendResponse(request, 200, "application/json", output);
+}
 
-	output += PSTR("]");
-	DEBUG_VERBOSE_P("%s", output.c_str());
-	request->send(200, "text/json", output);
+// Return index of file content type in contentTypes table
+uint8_t AsyncFFWebServer::getContentTypeId(const String &filename) {
+	uint8_t i;
+	for (i = 0; i < CONTENT_TYPE_COUNT - 1; i++) {
+		if (filename.endsWith(contentTypes[i].extension)) {
+			break;
+		}
+	}
+	return i;
 }
 
 // Return data type giving file type
 String AsyncFFWebServer::getContentType(String filename, AsyncWebServerRequest *request) {
 	if (request->hasArg("download")) return "application/octet-stream";
-	else if (filename.endsWith(".htm")) return "text/html";
-	else if (filename.endsWith(".html")) return "text/html";
-	else if (filename.endsWith(".css")) return "text/css";
-	else if (filename.endsWith(".js")) return "application/javascript";
-	else if (filename.endsWith(".json")) return "application/json";
-	else if (filename.endsWith(".png")) return "image/png";
-	else if (filename.endsWith(".gif")) return "image/gif";
-	else if (filename.endsWith(".jpg")) return "image/jpeg";
-	else if (filename.endsWith(".ico")) return "image/x-icon";
-	else if (filename.endsWith(".xml")) return "text/xml";
-	else if (filename.endsWith(".pdf")) return "application/x-pdf";
-	else if (filename.endsWith(".zip")) return "application/x-zip";
-	else if (filename.endsWith(".gz")) return "application/x-gzip";
-	return "text/plain";
+	return contentTypes[getContentTypeId(filename)].contentType;
+}
+
+// Return index entry of a path, NULL if not found
+ffFileIndex_t *AsyncFFWebServer::findFileIndex(const String &path) {
+	uint32_t hash = bufferHash(path.c_str(), path.length());
+	uint32_t check = bufferCheck(path.c_str(), path.length());
+	auto entry = std::lower_bound(fileIndex.begin(), fileIndex.end(), hash,
+		[](const ffFileIndex_t &item, const uint32_t value) { return item.hash < value; });
+	// Paths with same hash are consecutive, check hash tells them apart
+	for (; entry != fileIndex.end() && entry->hash == hash; entry++) {
+		if (entry->check == check) {
+			return &(*entry);
+		}
+	}
+	return NULL;
+}
+
+// Return index entry of a path, creating it if needed
+ffFileIndex_t *AsyncFFWebServer::insertFileIndex(const String &path) {
+	uint32_t hash = bufferHash(path.c_str(), path.length());
+	uint32_t check = bufferCheck(path.c_str(), path.length());
+	auto entry = std::lower_bound(fileIndex.begin(), fileIndex.end(), hash,
+		[](const ffFileIndex_t &item, const uint32_t value) { return item.hash < value; });
+	for (; entry != fileIndex.end() && entry->hash == hash; entry++) {
+		if (entry->check == check) {
+			return &(*entry);
+		}
+	}
+	ffFileIndex_t item = {hash, check, 0, 0, getContentTypeId(path)};
+	entry = fileIndex.insert(entry, item);
+	return &(*entry);
+}
+
+// Check if a path has been searched on file system without success for less than FF_FILE_MISS_TTL
+bool AsyncFFWebServer::recentFileMiss(const String &path) {
+	uint32_t hash = bufferHash(path.c_str(), path.length());
+	for (uint8_t i = 0; i < FF_FILE_MISS_CACHE; i++) {
+		if (fileMisses[i].hash == hash && (millis() - fileMisses[i].time) < FF_FILE_MISS_TTL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Remember (or forget, if found is true) that a path is not on file system
+void AsyncFFWebServer::setFileMiss(const String &path, const bool found) {
+	uint32_t hash = bufferHash(path.c_str(), path.length());
+	for (uint8_t i = 0; i < FF_FILE_MISS_CACHE; i++) {
+		if (fileMisses[i].hash == hash) {
+			fileMisses[i].time = millis() - FF_FILE_MISS_TTL;
+		}
+	}
+	if (!found) {
+		fileMisses[fileMissNext].hash = hash;
+		fileMisses[fileMissNext].time = millis();
+		fileMissNext = (fileMissNext + 1) % FF_FILE_MISS_CACHE;
+	}
+}
+
+// Add a file into index
+void AsyncFFWebServer::addFileIndex(const String &path, const size_t size) {
+	ffFileIndex_t *entry = insertFileIndex(path);
+	entry->flags |= FF_FILE_PLAIN;
+	if (!(entry->flags & FF_FILE_GZ)) {
+		entry->size = size;
+	}
+	// Compressed file is also indexed under uncompressed name, as it's sent instead of it
+	if (path.endsWith(PSTR(".gz"))) {
+		entry = insertFileIndex(path.substring(0, path.length() - 3));
+		entry->flags |= FF_FILE_GZ;
+		entry->size = size;
+	}
+}
+
+// Add all files of a folder (and its subfolders) into index
+void AsyncFFWebServer::addFolderIndex(const String &folder) {
+	Dir dir = _fs->openDir(folder);
+	while (dir.next()) {
+		if (dir.isDirectory()) {
+			addFolderIndex(folder + dir.fileName() + PSTR("/"));
+		} else {
+			addFileIndex(folder + dir.fileName(), dir.fileSize());
+		}
+	}
+}
+
+// Build index of files on file system, to avoid exists() calls when serving static files
+void AsyncFFWebServer::buildFileIndex(void) {
+	fileIndex.clear();
+	for (uint8_t i = 0; i < FF_FILE_MISS_CACHE; i++) {
+		fileMisses[i].hash = 0;
+		fileMisses[i].time = millis() - FF_FILE_MISS_TTL;
+	}
+	addFolderIndex(PSTR("/"));
+	DEBUG_VERBOSE_P("%u files indexed", fileIndex.size());
+}
+
+// Update index after a file has been written or deleted (path can be compressed or uncompressed name)
+void AsyncFFWebServer::updateFileIndex(String path) {
+	if (path.endsWith(PSTR(".gz"))) {
+		path = path.substring(0, path.length() - 3);
+	}
+	String pathWithGz = path + PSTR(".gz");
+	setFileMiss(path, true);
+	// Remove both names, then add existing ones
+	for (const String *name : {&path, &pathWithGz}) {
+		ffFileIndex_t *entry = findFileIndex(*name);
+		if (entry) {
+			fileIndex.erase(fileIndex.begin() + (entry - fileIndex.data()));
+		}
+	}
+	for (const String *name : {&path, &pathWithGz}) {
+		if (_fs->exists(*name)) {
+			File file = _fs->open(*name, "r");
+			if (file && !file.isDirectory()) {
+				addFileIndex(*name, file.size());
+			}
+			file.close();
+		}
+	}
+}
+
+// Return Cache-Control header value for a path
+String AsyncFFWebServer::getCacheControl(const String &path) {
+	for (uint8_t i = 0; i < cacheRuleCount; i++) {
+		const String &pattern = cacheRules[i].pattern;
+		bool match;
+		if (pattern.startsWith("*")) {
+			match = path.endsWith(pattern.c_str() + 1);
+		} else if (pattern.endsWith("*")) {
+			match = path.startsWith(pattern.substring(0, pattern.length() - 1));
+		} else {
+			match = (path == pattern);
+		}
+		if (match) {
+			if (cacheRules[i].maxAge < 0) {
+				return PSTR("no-store");
+			}
+			if (cacheRules[i].maxAge == 0) {
+				return PSTR("no-cache");
+			}
+			return String(PSTR("max-age=")) + String(cacheRules[i].maxAge);
+		}
+	}
+	// Browser should check ETag before using its copy
+	return PSTR("no-cache");
+}
+
+#ifdef FF_EMBED_ASSETS
+	// Send a file embedded by makeassets.py, directly from flash. Returns false if not embedded
+	bool AsyncFFWebServer::sendEmbeddedAsset(const String &path, AsyncWebServerRequest *request) {
+		for (size_t i = 0; i < FF_EMBEDDED_ASSET_COUNT; i++) {
+			const ffEmbeddedAsset_t *asset = &FF_EMBEDDED_ASSETS[i];
+			if (strcmp_P(path.c_str(), (const char *) pgm_read_ptr(&asset->path))) {
+				continue;
+			}
+			char etag[24];
+			strncpy_P(etag, (const char *) pgm_read_ptr(&asset->etag), sizeof(etag));
+			etag[sizeof(etag) - 1] = 0;
+			String cacheControl = getCacheControl(path);
+			AsyncWebServerResponse *response;
+			if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+				response = request->beginResponse(304);
+				metricsResponse(304);
+				DEBUG_VERBOSE_P("Embedded %s not modified", path.c_str());
+			} else {
+				response = request->beginResponse_P(200, getContentType(path, request),
+					(const uint8_t *) pgm_read_ptr(&asset->data), pgm_read_dword(&asset->length));
+				response->addHeader("Content-Encoding", "gzip");
+				metricsResponse(200, pgm_read_dword(&asset->length));
+				DEBUG_VERBOSE_P("Embedded %s sent", path.c_str());
+			}
+			response->addHeader("ETag", etag);
+			response->addHeader("Cache-Control", cacheControl);
+			request->send(response);
+			return true;
+		}
+		return false;
+	}
+#endif
+
+// Check that a string is not empty and only contains digits
+static bool isNumber(const String &text) {
+	if (!text.length()) {
+		return false;
+	}
+	for (size_t i = 0; i < text.length(); i++) {
+		if (!isDigit(text[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+
+	Send part of a file, as requested by a "Range: bytes=" header, with a 206 answer
+
+	Only one range is supported, a 416 answer is sent for unsatisfiable ranges (starting after end of file).
+	Returns false if whole file should be sent (unknown range unit, invalid or multiple ranges,
+		or file changed since If-Range ETag), as invalid Range headers are ignored (RFC 7233)
+
+*/
+bool AsyncFFWebServer::sendFileRange(AsyncWebServerRequest *request, File &file, const String &path, const String &contentType, const char *etag) {
+	if (request->hasHeader("If-Range") && request->header("If-Range") != etag) {
+		return false;
+	}
+	String range = request->header("Range");
+	if (!range.startsWith(PSTR("bytes="))) {
+		return false;
+	}
+	range = range.substring(6);
+	range.trim();
+	int dash = range.indexOf('-');
+	if (dash < 0 || range.indexOf(',') >= 0) {
+		return false;
+	}
+	String first = range.substring(0, dash);
+	String last = range.substring(dash + 1);
+	first.trim();
+	last.trim();
+
+	size_t size = file.size();
+	size_t start = 0;
+	size_t end = 0;
+	bool valid;
+	if (first.length()) {
+		// bytes=start- or bytes=start-end
+		if (!isNumber(first) || (last.length() && !isNumber(last))) {
+			return false;
+		}
+		start = strtoul(first.c_str(), NULL, 10);
+		end = last.length() ? strtoul(last.c_str(), NULL, 10) : size - 1;
+		if (last.length() && end < start) {
+			return false;
+		}
+		if (end >= size) {
+			end = size - 1;
+		}
+		valid = start < size;
+	} else {
+		// bytes=-length: last length bytes
+		if (!isNumber(last)) {
+			return false;
+		}
+		size_t length = strtoul(last.c_str(), NULL, 10);
+		start = (length >= size) ? 0 : size - length;
+		end = size - 1;
+		valid = length && size;
+	}
+
+	AsyncWebServerResponse *response;
+	if (!valid) {
+		file.close();
+		DEBUG_ERROR_P("Can't satisfy range %s of %s", range.c_str(), path.c_str());
+		response = request->beginResponse(416);
+		response->addHeader("Content-Range", String(PSTR("bytes */")) + String(size));
+		metricsResponse(416);
+		request->send(response);
+		return true;
+	}
+
+	file.seek(start);
+	response = request->beginResponse(contentType, end - start + 1, [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+		return file.read(buffer, maxLen);
+	});
+	response->setCode(206);
+	metricsResponse(206, end - start + 1);
+	char header[64];
+	snprintf_P(header, sizeof(header), PSTR("bytes %u-%u/%u"), start, end, size);
+	response->addHeader("Content-Range", header);
+	response->addHeader("ETag", etag);
+	snprintf_P(header, sizeof(header), PSTR("inline; filename=\"%s\""), path.substring(path.lastIndexOf('/') + 1).c_str());
+	response->addHeader("Content-Disposition", header);
+	request->send(response);
+	return true;
 }
 
 // Return content of a file
@@ -1419,16 +2279,88 @@ bool AsyncFFWebServer::handleFileRead(String path, AsyncWebServerRequest *reques
 	#endif
 	if (path.endsWith("/"))
 		path += PSTR("index.htm");
-	String contentType = getContentType(path, request);
-	String pathWithGz = path + PSTR(".gz");
-	if (_fs->exists(pathWithGz) || _fs->exists(path)) {
-		if (_fs->exists(pathWithGz)) {
+	#ifdef FF_CONFIG_USE_MSGPACK
+		// Binary configuration files are never sent as is (they're only available in JSON format, subject to HIDE_SECRET/HIDE_CONFIG)
+		if (path.endsWith(CONFIG_BINARY_EXTENSION)) {
+			String jsonName = path;
+			jsonName.replace(PSTR(CONFIG_BINARY_EXTENSION), PSTR(".json"));
+			if (isConfigFile(jsonName)) {
+				DEBUG_ERROR_P("Refusing to send %s", path.c_str());
+				return false;
+			}
+		}
+		// Configuration files are stored in binary format, send them in JSON format
+		if (isConfigFile(path) && !_fs->exists(path)) {
+			JsonDocument jsonDoc;
+			if (path != USER_CONFIG_FILE) {
+				if (!readConfigFile(path.c_str(), jsonDoc, NULL)) {
+					return false;
+				}
+			} else if (!userConfigLoaded && !readUserConfigFile()) {
+				return false;
+			}
+			AsyncResponseStream *response = request->beginResponseStream(getContentType(path, request));
+			metricsResponse(200, serializeJson(path == USER_CONFIG_FILE ? userConfigDoc : jsonDoc, *response));
+			request->send(response);
+			return true;
+		}
+	#endif
+	ffFileIndex_t *entry = findFileIndex(path);
+	if (!entry && !recentFileMiss(path)) {
+		// File may have been written by user's code since index was built, check it again (not at each request)
+		updateFileIndex(path);
+		entry = findFileIndex(path);
+		if (!entry) {
+			setFileMiss(path, false);
+		}
+	}
+	#ifdef FF_EMBED_ASSETS
+		// Embedded file is sent only if not found on file system
+		if (!entry && sendEmbeddedAsset(path, request)) {
+			return true;
+		}
+	#endif
+	if (entry) {
+		String contentType = request->hasArg("download") ? String(PSTR("application/octet-stream")) : String(contentTypes[entry->contentType].contentType);
+		String cacheControl = getCacheControl(path);
+		if (entry->flags & FF_FILE_GZ) {
 			path += PSTR(".gz");
 		}
 		DEBUG_VERBOSE_P("Content type: %s", contentType.c_str());
-		AsyncWebServerResponse *response = request->beginResponse(*_fs, path, contentType);
-		if (path.endsWith(PSTR(".gz")))
+		File file = _fs->open(path, "r");
+		if (!file) {
+			// File has been removed by user's code since index was built
+			DEBUG_ERROR_P("Cannot open %s", path.c_str());
+			updateFileIndex(path);
+			return false;
+		}
+		// Validator is computed from file size and last write time
+		char etag[24];
+		snprintf_P(etag, sizeof(etag), PSTR("\"%x-%x\""), file.size(), (uint32_t) file.getLastWrite());
+		if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+			file.close();
+			AsyncWebServerResponse *response = request->beginResponse(304);
+			response->addHeader("ETag", etag);
+			response->addHeader("Cache-Control", cacheControl);
+			metricsResponse(304);
+			request->send(response);
+			DEBUG_VERBOSE_P("File %s not modified", path.c_str());
+			return true;
+		}
+		bool compressed = path.endsWith(PSTR(".gz"));
+		// Partial content is only sent for uncompressed files
+		if (!compressed && request->hasHeader("Range") && sendFileRange(request, file, path, contentType, etag)) {
+			DEBUG_VERBOSE_P("File %s range sent", path.c_str());
+			return true;
+		}
+		metricsResponse(200, file.size());
+		AsyncWebServerResponse *response = request->beginResponse(file, path, contentType);
+		// No Accept-Ranges header: ESPAsyncWebServer always adds "none", Range requests are still answered with 206
+		if (compressed) {
 			response->addHeader("Content-Encoding", "gzip");
+		}
+		response->addHeader("ETag", etag);
+		response->addHeader("Cache-Control", cacheControl);
 		DEBUG_VERBOSE_P("File %s exist", path.c_str());
 		request->send(response);
 		DEBUG_VERBOSE_P("File %s Sent", path.c_str());
@@ -1443,214 +2375,1556 @@ bool AsyncFFWebServer::handleFileRead(String path, AsyncWebServerRequest *reques
 // Create a file on file system
 void AsyncFFWebServer::handleFileCreate(AsyncWebServerRequest *request) {
 	if (!checkAuth(request))
-		return request->requestAuthentication();
+		return requestAuth(request);
 	if (request->args() == 0)
-		return request->send(500, "text/plain", "BAD ARGS");
+		return sendResponse(request, 500, "text/plain", "BAD ARGS");
 	String path = request->arg(0U);
 	DEBUG_VERBOSE_P("handleFileCreate: %s", path.c_str());
 	if (path == "/")
-		return request->send(500, "text/plain", "BAD PATH");
+		return sendResponse(request, 500, "text/plain", "BAD PATH");
 	if (_fs->exists(path))
-		return request->send(500, "text/plain", "FILE EXISTS");
+		return sendResponse(request, 500, "text/plain", "FILE EXISTS");
 	File file = _fs->open(path, "w");
 	if (file) {
 		file.close();
 	} else {
-		return request->send(500, "text/plain", "CREATE FAILED");
+		return sendResponse(request, 500, "text/plain", "CREATE FAILED");
+	}
+	if (path == USER_CONFIG_FILE) {
+		userConfigLoaded = false;							// Force user config cache reload
 	}
-	request->send(200, "text/plain", "");
+	updateFileIndex(path);
+	sendResponse(request, 200, "text/plain", "");
 	path = String();
 }
 
 // Delete a file on file system
 void AsyncFFWebServer::handleFileDelete(AsyncWebServerRequest *request) {
 	if (!checkAuth(request))
-		return request->requestAuthentication();
-	if (request->args() == 0) return request->send(500, "text/plain", "BAD ARGS");
+		return requestAuth(request);
+	if (request->args() == 0) return sendResponse(request, 500, "text/plain", "BAD ARGS");
 	String path = request->arg(0U);
 	if (path.startsWith("//"))
 		path = path.substring(1);
 	DEBUG_ERROR_P("handleFileDelete: %s", path.c_str());
 	if (path == "/")
-		return request->send(500, "text/plain", "BAD PATH");
-	if (!_fs->exists(path))
-		return error404(request);
-	_fs->remove(path);
-	request->send(200, "text/plain", "");
+		return sendResponse(request, 500, "text/plain", "BAD PATH");
+	if (isConfigFile(path)) {
+		// Configuration files may be stored in binary format
+		if (!configFileExists(path.c_str()))
+			return error404(request);
+		removeConfigFile(path.c_str());
+	} else {
+		if (!_fs->exists(path))
+			return error404(request);
+		_fs->remove(path);
+	}
+	if (path == USER_CONFIG_FILE) {
+		userConfigLoaded = false;							// Force user config cache reload
+	}
+	updateFileIndex(path);
+	sendResponse(request, 200, "text/plain", "");
 	path = String(); // Remove? Useless statement?
 }
 
-// Download a file
-void AsyncFFWebServer::handleFileUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
-	static File fsUploadFile;
-	static size_t fileSize = 0;
+/*
 
-	if (!index) { // Start
-		DEBUG_VERBOSE_P("handleFileUpload Name: %s", filename.c_str());
-		if (!filename.startsWith("/")) filename = PSTR("/") + filename;
-		fsUploadFile = _fs->open(filename, "w");
-		DEBUG_VERBOSE_P("First upload part");
+	Receive an uploaded file (/edit POST)
 
+	Each upload has its own context, so simultaneous uploads don't mix.
+	Received chunks (of any size) are gathered in a FF_UPLOAD_BLOCK_SIZE buffer written to a temporary file
+		when full, to reduce the number of flash writes.
+	Temporary file replaces requested one only when upload is complete and request handler has been called
+		(request admitted and not rate limited), so an interrupted or rejected upload keeps previous file.
+	When a md5 parameter (hex) is given in URL, or in form before file, MD5 of received data should match it.
+	Errors are kept in request _tempObject, to be sent by request handler.
+
+*/
+void AsyncFFWebServer::handleFileUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
+	ffUploadContext_t *upload = NULL;
+	for (uint8_t i = 0; i < FF_UPLOAD_CONTEXTS; i++) {
+		// Completed uploads of previous files of request are waiting for handler
+		if (uploads[i].request == request && !uploads[i].complete) {
+			upload = &uploads[i];
+			break;
+		}
+	}
+	if (!index) { // Start
+		if (upload) {
+			abortUpload(upload);
+		}
+		upload = startUpload(request, filename);
+	}
+	if (!upload) {
+		return;
 	}
 	// Continue
-	if (fsUploadFile) {
-		DEBUG_VERBOSE_P("Continue upload part. Size = %u", len);
-		if (fsUploadFile.write(data, len) != len) {
-			DEBUG_ERROR_P("Write error during upload", NULL);
-		} else {
-			fileSize += len;
+	if (len) {
+		upload->md5.add(data, len);
+		upload->size += len;
+		if (!writeUpload(upload, data, len)) {
+			DEBUG_ERROR_P("Write error during upload of %s", upload->path.c_str());
+			setUploadError(request, "Write error");
+			abortUpload(upload);
+			return;
 		}
 	}
 	if (final) { // End
-		if (fsUploadFile) {
-			fsUploadFile.close();
-		}
-		DEBUG_VERBOSE_P("handleFileUpload Size: %u", fileSize);
-		fileSize = 0;
+		finishUpload(upload);
 	}
 }
 
-// Send general configuration data
-void AsyncFFWebServer::send_general_configuration_values_html(AsyncWebServerRequest *request) {
-	String values;
-	values = PSTR("devicename|") + (String)_config.deviceName + PSTR("|input\n")
-		+ PSTR("userversion|") + serverVersion + PSTR("|div\n");
-	request->send(200, "text/plain", values);
+// Allocate an upload context and open its temporary file
+ffUploadContext_t *AsyncFFWebServer::startUpload(AsyncWebServerRequest *request, String filename) {
+	if (!filename.startsWith("/")) filename = PSTR("/") + filename;
+	ffUploadContext_t *upload = NULL;
+	uint8_t slot;
+	for (slot = 0; slot < FF_UPLOAD_CONTEXTS; slot++) {
+		if (!uploads[slot].request) {
+			upload = &uploads[slot];
+			break;
+		}
+	}
+	if (!upload) {
+		DEBUG_ERROR_P("Too many uploads, %s refused", filename.c_str());
+		setUploadError(request, "Too many uploads");
+		return NULL;
+	}
+	snprintf_P(upload->tempPath, sizeof(upload->tempPath), PSTR("/upload%u.tmp"), slot);
+	upload->file = _fs->open(upload->tempPath, "w");
+	if (!upload->file) {
+		DEBUG_ERROR_P("Can't create %s", upload->tempPath);
+		setUploadError(request, "Can't create file");
+		return NULL;
+	}
+	upload->request = request;
+	upload->client = request->client();
+	upload->path = filename;
+	// Without buffer (low memory), chunks are written as received
+	upload->buffer = (uint8_t *) malloc(FF_UPLOAD_BLOCK_SIZE);
+	upload->used = 0;
+	upload->size = 0;
+	upload->writes = 0;
+	upload->md5.begin();
+	upload->startTime = millis();
+	upload->complete = false;
+	DEBUG_VERBOSE_P("handleFileUpload Name: %s, buffer: %d", filename.c_str(), upload->buffer != NULL);
+	return upload;
 }
 
-// Send network configuration data
-void AsyncFFWebServer::send_network_configuration_values_html(AsyncWebServerRequest *request) {
-	String values;
-
-	values = PSTR("ssid|") + (String)_config.ssid + PSTR("|input\n")
-		+ PSTR("password|") + (String)_config.password + PSTR("|input\n")
-		+ PSTR("ip_0|") + (String)_config.ip[0] + PSTR("|input\n")
-		+ PSTR("ip_1|") + (String)_config.ip[1] + PSTR("|input\n")
-		+ PSTR("ip_2|") + (String)_config.ip[2] + PSTR("|input\n")
-		+ PSTR("ip_3|") + (String)_config.ip[3] + PSTR("|input\n")
-		+ PSTR("nm_0|") + (String)_config.netmask[0] + PSTR("|input\n")
-		+ PSTR("nm_1|") + (String)_config.netmask[1] + PSTR("|input\n")
-		+ PSTR("nm_2|") + (String)_config.netmask[2] + PSTR("|input\n")
-		+ PSTR("nm_3|") + (String)_config.netmask[3] + PSTR("|input\n")
-		+ PSTR("gw_0|") + (String)_config.gateway[0] + PSTR("|input\n")
-		+ PSTR("gw_1|") + (String)_config.gateway[1] + PSTR("|input\n")
-		+ PSTR("gw_2|") + (String)_config.gateway[2] + PSTR("|input\n")
-		+ PSTR("gw_3|") + (String)_config.gateway[3] + PSTR("|input\n")
-		+ PSTR("dns_0|") + (String)_config.dns[0] + PSTR("|input\n")
-		+ PSTR("dns_1|") + (String)_config.dns[1] + PSTR("|input\n")
-		+ PSTR("dns_2|") + (String)_config.dns[2] + PSTR("|input\n")
-		+ PSTR("dns_3|") + (String)_config.dns[3] + PSTR("|input\n")
-		+ PSTR("dhcp|") + (String)(_config.dhcp ? PSTR("checked") : "") + PSTR("|chk\n");
-
-	request->send(200, "text/plain", values);
-	values = "";
+// Add data to upload buffer, writing buffer to temporary file each time it's full
+bool AsyncFFWebServer::writeUpload(ffUploadContext_t *upload, const uint8_t *data, const size_t len) {
+	if (!upload->buffer) {
+		upload->writes++;
+		return upload->file.write(data, len) == len;
+	}
+	size_t done = 0;
+	while (done < len) {
+		// Write full blocks directly when buffer is empty
+		if (!upload->used && (len - done) >= FF_UPLOAD_BLOCK_SIZE) {
+			upload->writes++;
+			if (upload->file.write(data + done, FF_UPLOAD_BLOCK_SIZE) != FF_UPLOAD_BLOCK_SIZE) {
+				return false;
+			}
+			done += FF_UPLOAD_BLOCK_SIZE;
+			continue;
+		}
+		size_t count = std::min(len - done, (size_t) FF_UPLOAD_BLOCK_SIZE - upload->used);
+		memcpy(upload->buffer + upload->used, data + done, count);
+		upload->used += count;
+		done += count;
+		if (upload->used == FF_UPLOAD_BLOCK_SIZE) {
+			upload->writes++;
+			if (upload->file.write(upload->buffer, upload->used) != upload->used) {
+				return false;
+			}
+			upload->used = 0;
+		}
+	}
+	return true;
 }
 
-// Send connection state
-void AsyncFFWebServer::send_connection_state_values_html(AsyncWebServerRequest *request) {
-	String state = PSTR("N/A");
-	String Networks = "";
-	if (WiFi.status() == 0) state = PSTR("Idle");
-	else if (WiFi.status() == 1) state = PSTR("NO SSID AVAILBLE");
-	else if (WiFi.status() == 2) state = PSTR("SCAN COMPLETED");
-	else if (WiFi.status() == 3) state = PSTR("CONNECTED");
-	else if (WiFi.status() == 4) state = PSTR("CONNECT FAILED");
-	else if (WiFi.status() == 5) state = PSTR("CONNECTION LOST");
-	else if (WiFi.status() == 6) state = PSTR("DISCONNECTED");
-
-	WiFi.scanNetworks(true);
-
-	String values = PSTR("connectionstate|") + state + PSTR("|div\n");
-	//values += "networks|Scanning networks ...|div\n";
-	request->send(200, "text/plain", values);
-	state = "";
-	values = "";
-	Networks = "";
+// Write end of upload and check its MD5, keeping temporary file until request handler is called
+void AsyncFFWebServer::finishUpload(ffUploadContext_t *upload) {
+	AsyncWebServerRequest *request = upload->request;
+	const char *error = NULL;
+	if (upload->used) {
+		upload->writes++;
+		if (upload->file.write(upload->buffer, upload->used) != upload->used) {
+			error = "Write error";
+		}
+		upload->used = 0;
+	}
+	upload->file.close();
+	upload->md5.calculate();
+	String md5 = upload->md5.toString();
+	String expected;
+	if (request->hasParam("md5")) {
+		expected = request->getParam("md5")->value();
+	} else if (request->hasParam("md5", true)) {
+		expected = request->getParam("md5", true)->value();
+	}
+	if (!error && expected.length() && !expected.equalsIgnoreCase(md5)) {
+		error = "MD5 mismatch";
+	}
+	if (error) {
+		DEBUG_ERROR_P("Upload of %s failed: %s", upload->path.c_str(), error);
+		setUploadError(request, error);
+		abortUpload(upload);
+		return;
+	}
+	unsigned long duration = millis() - upload->startTime;
+	trace_info_P("Uploaded %s: %u bytes in %lu ms (%lu bytes/s), %u writes, MD5 %s", upload->path.c_str(), upload->size, duration,
+		(unsigned long) (duration ? ((uint64_t) upload->size * 1000) / duration : upload->size), upload->writes, md5.c_str());
+	// Buffer is no longer needed while waiting for handler
+	if (upload->buffer) {
+		free(upload->buffer);
+		upload->buffer = NULL;
+	}
+	upload->complete = true;
 }
 
-// Send information data
-void AsyncFFWebServer::send_information_values_html(AsyncWebServerRequest *request) {
-	String values = 
-		  PSTR("x_ssid|") + (String)WiFi.SSID() + PSTR("|div\n")
-		+ PSTR("x_ip|") + (String)WiFi.localIP()[0] + "." + (String)WiFi.localIP()[1] + "." + (String)WiFi.localIP()[2] + "." + (String)WiFi.localIP()[3] + PSTR("|div\n")
-		+ PSTR("x_gateway|") + (String)WiFi.gatewayIP()[0] + "." + (String)WiFi.gatewayIP()[1] + "." + (String)WiFi.gatewayIP()[2] + "." + (String)WiFi.gatewayIP()[3] + PSTR("|div\n")
-		+ PSTR("x_netmask|") + (String)WiFi.subnetMask()[0] + "." + (String)WiFi.subnetMask()[1] + "." + (String)WiFi.subnetMask()[2] + "." + (String)WiFi.subnetMask()[3] + PSTR("|div\n")
-		+ PSTR("x_mac|") + getMacAddress() + PSTR("|div\n")
-		+ PSTR("x_dns|") + (String)WiFi.dnsIP()[0] + "." + (String)WiFi.dnsIP()[1] + "." + (String)WiFi.dnsIP()[2] + "." + (String)WiFi.dnsIP()[3] + PSTR("|div\n")
-		+ PSTR("x_ntp_sync|") + NTP.getTimeDateString(NTP.getLastNTPSync()) + PSTR("|div\n")
-		+ PSTR("x_ntp_time|") + NTP.getTimeStr() + PSTR("|div\n")
-		+ PSTR("x_ntp_date|") + NTP.getDateStr() + PSTR("|div\n")
-		+ PSTR("x_uptime|") + NTP.getUptimeString() + PSTR("|div\n")
-		+ PSTR("x_last_boot|") + NTP.getTimeDateString(NTP.getLastBootTime()) + PSTR("|div\n");
-
-	request->send(200, "text/plain", values);
-	//delete &values;
-	values = "";
+// Replace requested files by completed uploads of a request (called by admitted request handler)
+void AsyncFFWebServer::commitUploads(AsyncWebServerRequest *request) {
+	for (uint8_t i = 0; i < FF_UPLOAD_CONTEXTS; i++) {
+		ffUploadContext_t *upload = &uploads[i];
+		if (upload->request != request || !upload->complete) {
+			continue;
+		}
+		const char *error = NULL;
+		if (!_fs->rename(upload->tempPath, upload->path.c_str())) {
+			// Rename fails when folder doesn't exist, create it with an empty file
+			File file = _fs->open(upload->path, "w");
+			file.close();
+			if (!_fs->rename(upload->tempPath, upload->path.c_str())) {
+				error = "Rename error";
+			}
+		}
+		if (error) {
+			DEBUG_ERROR_P("Upload of %s failed: %s", upload->path.c_str(), error);
+			setUploadError(request, error);
+			_fs->remove(upload->tempPath);
+		} else {
+			if (upload->path == USER_CONFIG_FILE) {
+				userConfigLoaded = false;					// Force user config cache reload
+			}
+			updateFileIndex(upload->path);
+		}
+		releaseUpload(upload);
+	}
 }
 
-// Get ESP8266 MAC address
-String AsyncFFWebServer::getMacAddress() {
-	uint8_t mac[6];
-	char macStr[18] = { 0 };
-	WiFi.macAddress(mac);
-	sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-	return String(macStr);
+// Stop an upload, keeping previous file
+void AsyncFFWebServer::abortUpload(ffUploadContext_t *upload) {
+	DEBUG_VERBOSE_P("Upload of %s aborted after %u bytes", upload->path.c_str(), upload->size);
+	upload->file.close();
+	_fs->remove(upload->tempPath);
+	releaseUpload(upload);
 }
 
-// Send NTP configuration data
-void AsyncFFWebServer::send_NTP_configuration_values_html(AsyncWebServerRequest *request) {
-	String values = 
-		  PSTR("ntpserver|") + (String)_config.ntpServerName + PSTR("|input\n")
-		+ PSTR("update|") + (String)_config.updateNTPTimeEvery + PSTR("|input\n")
-		+ PSTR("tz|") + (String)_config.timezone + PSTR("|input\n")
-		+ PSTR("dst|") + (String)(_config.daylight ? PSTR("checked") : "") + PSTR("|chk\n");
-	request->send(200, "text/plain", values);
+// Free an upload context
+void AsyncFFWebServer::releaseUpload(ffUploadContext_t *upload) {
+	if (upload->buffer) {
+		free(upload->buffer);
+		upload->buffer = NULL;
+	}
+	upload->request = NULL;
+	upload->client = NULL;
+	upload->complete = false;
+	upload->path = String();
 }
 
-// Convert a single hex digit character to its integer value (from https://code.google.com/p/avr-netino/)
-unsigned char AsyncFFWebServer::h2int(char c) {
-	if (c >= '0' && c <= '9') {
-		return((unsigned char)c - '0');
-	}
-	if (c >= 'a' && c <= 'f') {
-		return((unsigned char)c - 'a' + 10);
-	}
-	if (c >= 'A' && c <= 'F') {
-		return((unsigned char)c - 'A' + 10);
+// Keep first upload error in request, to be sent by request handler (freed with request)
+void AsyncFFWebServer::setUploadError(AsyncWebServerRequest *request, const char *message) {
+	if (!request->_tempObject) {
+		request->_tempObject = strdup(message);
 	}
-	return(0);
 }
 
-// Decode an URL (replace + by space and %xx by its ascii hexa code
-String AsyncFFWebServer::urldecode(String input) {		// (based on https://code.google.com/p/avr-netino/) {
-	char c;
-	String ret = "";
+// ----- Values response -----
 
-	for (byte t = 0; t < input.length(); t++) {
-		c = input[t];
-		if (c == '+') c = ' ';
-		if (c == '%') {
-			t++;
-			c = input[t];
-			t++;
-			c = (h2int(c) << 4) | h2int(input[t]);
-		}
-		ret.concat(c);
+/*!
+
+	Create a "name|value|type" response (as read by setValues() in microajax.js)
+
+	Values are written directly into an AsyncResponseStream, without building temporary Strings.
+		Names and types can be in flash (PSTR) or in RAM.
+
+	\param[in]	request: request to answer
+	\return	None
+
+*/
+FF_ValuesResponse::FF_ValuesResponse(AsyncWebServerRequest *request) {
+	_request = request;
+	_stream = request->beginResponseStream("text/plain");
+	_out.output = _stream;
+	// Keep a copy of response if its URL is cached
+	if (FF_WebServer.isResponseCached(request)) {
+		_copy.reserve(256);
+		_out.copy = &_copy;
+		_out.copyLimit = FF_RESPONSE_CACHE_SIZE;
 	}
-	return ret;
+}
 
+// Write name and first separator
+void FF_ValuesResponse::start(PGM_P name) {
+	_out.print(FPSTR(name));
+	_out.write('|');
 }
 
-// Check the Values is between 0-255
-boolean AsyncFFWebServer::checkRange(String Value) {
-	if (Value.toInt() < 0 || Value.toInt() > 255) {
-		return false;
-	} else {
-		return true;
-	}
+// Write second separator, type and end of line
+void FF_ValuesResponse::end(PGM_P type) {
+	_out.write('|');
+	_out.print(FPSTR(type));
+	_out.write('\n');
 }
 
-//	Send network configuration data
+/*!
+
+	Add a value to response
+
+	\param[in]	name: value name (id of HTML element), in flash or RAM
+	\param[in]	value: value to send
+	\param[in]	type: value type (div, input, chk...), in flash or RAM
+	\return	A reference to this response, to chain calls
+
+*/
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const char *value, PGM_P type) {
+	start(name);
+	_out.print(value);
+	end(type);
+	return *this;
+}
+
+// Add a String value to response
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const String &value, PGM_P type) {
+	return add(name, value.c_str(), type);
+}
+
+// Add a flash string value to response
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const __FlashStringHelper *value, PGM_P type) {
+	start(name);
+	_out.print(value);
+	end(type);
+	return *this;
+}
+
+// Add an int value to response
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const int value, PGM_P type) {
+	return add(name, (long) value, type);
+}
+
+// Add an unsigned int value to response
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const unsigned int value, PGM_P type) {
+	return add(name, (unsigned long) value, type);
+}
+
+// Add a long value to response
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const long value, PGM_P type) {
+	start(name);
+	_out.print(value);
+	end(type);
+	return *this;
+}
+
+// Add an unsigned long value to response
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const unsigned long value, PGM_P type) {
+	start(name);
+	_out.print(value);
+	end(type);
+	return *this;
+}
+
+// Add a float value to response, with given decimal digits
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const float value, const int digits, PGM_P type) {
+	start(name);
+	_out.print(value, digits);
+	end(type);
+	return *this;
+}
+
+// Add an IP address to response (as a.b.c.d)
+FF_ValuesResponse& FF_ValuesResponse::add(PGM_P name, const IPAddress &value, PGM_P type) {
+	start(name);
+	_out.print(value);
+	end(type);
+	return *this;
+}
+
+// Add a checkbox state to response
+FF_ValuesResponse& FF_ValuesResponse::addChecked(PGM_P name, const bool checked) {
+	return add(name, checked ? F("checked") : F(""), PSTR("chk"));
+}
+
+// Add each byte of an IP address to response, as <prefix>_0 to <prefix>_3
+FF_ValuesResponse& FF_ValuesResponse::addOctets(PGM_P prefix, const IPAddress &value, PGM_P type) {
+	for (uint8_t i = 0; i < 4; i++) {
+		_out.print(FPSTR(prefix));
+		_out.write('_');
+		_out.write('0' + i);
+		_out.write('|');
+		_out.print(value[i]);
+		end(type);
+	}
+	return *this;
+}
+
+// Return underlying response stream, to write other data (response is then not cached)
+AsyncResponseStream *FF_ValuesResponse::getStream(void) {
+	_out.copy = NULL;
+	_copy = String();
+	return _stream;
+}
+
+// Send response
+void FF_ValuesResponse::send(void) {
+	if (_out.copy) {
+		FF_WebServer.storeCachedResponse(_request, "text/plain", _copy);
+	}
+	// Data written through getStream() is not counted
+	FF_WebServer.metricsResponse(200, _out.count);
+	_request->send(_stream);
+}
+
+// ----- Route parameters -----
+
+// Add a parameter (value is not copied)
+void FF_RouteParams::add(const char *name, const char *value, const size_t length) {
+	if (_count < FF_ROUTE_MAX_PARAMS) {
+		_names[_count] = name;
+		_values[_count] = value;
+		_lengths[_count] = (length > 255) ? 255 : length;
+		_count++;
+	}
+}
+
+/*!
+
+	Return number of path parameters
+
+	\param	None
+	\return	Number of parameters
+
+*/
+uint8_t FF_RouteParams::count(void) const {
+	return _count;
+}
+
+// Return name of a parameter given its index (NULL if index is too large)
+const char *FF_RouteParams::name(const uint8_t index) const {
+	return (index < _count) ? _names[index] : NULL;
+}
+
+// Return index of a parameter given its name (-1 if not found)
+int FF_RouteParams::find(const char *name) const {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (!strcmp(_names[i], name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Check if a parameter exists
+bool FF_RouteParams::has(const char *name) const {
+	return find(name) >= 0;
+}
+
+// Compare a parameter with a value (without copy)
+bool FF_RouteParams::equals(const char *name, const char *value) const {
+	int index = find(name);
+	return index >= 0 && strlen(value) == _lengths[index] && !memcmp(_values[index], value, _lengths[index]);
+}
+
+/*!
+
+	Return a parameter as integer (without copy)
+
+	\param[in]	name: parameter name
+	\param[in]	defaultValue: value returned if parameter is not found
+	\return	Parameter value
+
+*/
+long FF_RouteParams::getInt(const char *name, const long defaultValue) const {
+	int index = find(name);
+	if (index < 0) {
+		return defaultValue;
+	}
+	const char *value = _values[index];
+	uint8_t i = (_lengths[index] && *value == '-') ? 1 : 0;
+	long result = 0;
+	for (; i < _lengths[index] && isDigit(value[i]); i++) {
+		result = (result * 10) + (value[i] - '0');
+	}
+	return (*value == '-') ? -result : result;
+}
+
+/*!
+
+	Copy a parameter into a buffer
+
+	\param[in]	name: parameter name
+	\param[out]	buffer: buffer to copy parameter into (always null terminated, empty if not found)
+	\param[in]	size: buffer size
+	\return	Number of chars copied
+
+*/
+size_t FF_RouteParams::get(const char *name, char *buffer, const size_t size) const {
+	if (!size) {
+		return 0;
+	}
+	int index = find(name);
+	size_t length = (index < 0) ? 0 : _lengths[index];
+	if (length >= size) {
+		length = size - 1;
+	}
+	if (length) {
+		memcpy(buffer, _values[index], length);
+	}
+	buffer[length] = 0;
+	return length;
+}
+
+// Return a parameter as String (empty if not found)
+String FF_RouteParams::getString(const char *name) const {
+	String result;
+	int index = find(name);
+	if (index >= 0) {
+		result.concat(_values[index], _lengths[index]);
+	}
+	return result;
+}
+
+// Keep a copy of written data, giving up (and freeing copy) when it gets larger than limit
+void FF_TeePrint::keep(const uint8_t *buffer, size_t size) {
+	if (copy->length() + size > copyLimit) {
+		*copy = String();
+		copy = NULL;
+		return;
+	}
+	copy->concat((const char *) buffer, size);
+}
+
+// Write a char, keeping a copy if needed
+size_t FF_TeePrint::write(uint8_t c) {
+	if (copy) {
+		keep(&c, 1);
+	}
+	count++;
+	return output->write(c);
+}
+
+// Write a buffer, keeping a copy if needed
+size_t FF_TeePrint::write(const uint8_t *buffer, size_t size) {
+	if (copy) {
+		keep(buffer, size);
+	}
+	count += size;
+	return output->write(buffer, size);
+}
+
+// Send general configuration data
+void AsyncFFWebServer::send_general_configuration_values_html(AsyncWebServerRequest *request) {
+	FF_ValuesResponse values(request);
+	values.add(PSTR("devicename"), _config.deviceName, PSTR("input"))
+		.add(PSTR("userversion"), serverVersion)
+		.send();
+}
+
+// Send network configuration data
+void AsyncFFWebServer::send_network_configuration_values_html(AsyncWebServerRequest *request) {
+	FF_ValuesResponse values(request);
+	values.add(PSTR("ssid"), _config.ssid, PSTR("input"))
+		.add(PSTR("password"), _config.password, PSTR("input"))
+		.addOctets(PSTR("ip"), _config.ip)
+		.addOctets(PSTR("nm"), _config.netmask)
+		.addOctets(PSTR("gw"), _config.gateway)
+		.addOctets(PSTR("dns"), _config.dns)
+		.addChecked(PSTR("dhcp"), _config.dhcp)
+		.send();
+}
+
+// Send connection state
+void AsyncFFWebServer::send_connection_state_values_html(AsyncWebServerRequest *request) {
+	const __FlashStringHelper *state = F("N/A");
+	if (WiFi.status() == 0) state = F("Idle");
+	else if (WiFi.status() == 1) state = F("NO SSID AVAILBLE");
+	else if (WiFi.status() == 2) state = F("SCAN COMPLETED");
+	else if (WiFi.status() == 3) state = F("CONNECTED");
+	else if (WiFi.status() == 4) state = F("CONNECT FAILED");
+	else if (WiFi.status() == 5) state = F("CONNECTION LOST");
+	else if (WiFi.status() == 6) state = F("DISCONNECTED");
+
+	// Scan will be done in background, results being sent by /scan
+	requestWifiScan();
+
+	FF_ValuesResponse values(request);
+	values.add(PSTR("connectionstate"), state).send();
+}
+
+/*!
+
+	Push a value to index.htm
+
+	Pushed values are sent to connected pages through /events (as "name|value|type" lines),
+		only when changed, instead of pages polling /rest/values.
+		A newly connected page receives all pushed values.
+
+	\param[in]	name: value name (id of HTML element)
+	\param[in]	value: value to push
+	\param[in]	type: value type (div, input, chk)
+	\return	None
+
+*/
+void AsyncFFWebServer::pushValue(const char *name, const String &value, const char *type) {
+	for (ffPushValue_t &item : pushValues) {
+		if (item.name == name) {
+			if (item.value != value || item.type != type) {
+				item.value = value;
+				item.type = type;
+				item.dirty = true;
+				pushValuesDirty = true;
+			}
+			return;
+		}
+	}
+	ffPushValue_t item = {name, value, type, true};
+	pushValues.push_back(item);
+	pushValuesDirty = true;
+}
+
+// Push a char array value
+void AsyncFFWebServer::pushValue(const char *name, const char *value, const char *type) {
+	pushValue(name, String(value), type);
+}
+
+// Push a long value
+void AsyncFFWebServer::pushValue(const char *name, const long value, const char *type) {
+	pushValue(name, String(value), type);
+}
+
+// Push an int value
+void AsyncFFWebServer::pushValue(const char *name, const int value, const char *type) {
+	pushValue(name, String(value), type);
+}
+
+// Push an unsigned int value
+void AsyncFFWebServer::pushValue(const char *name, const unsigned int value, const char *type) {
+	pushValue(name, String(value), type);
+}
+
+// Push an unsigned long value
+void AsyncFFWebServer::pushValue(const char *name, const unsigned long value, const char *type) {
+	pushValue(name, String(value), type);
+}
+
+// Push a float value, with given decimal digits
+void AsyncFFWebServer::pushValue(const char *name, const double value, const int digits, const char *type) {
+	pushValue(name, String(value, digits), type);
+}
+
+// Format all or changed pushed values as "name|value|type" lines, clearing their changed flag
+String AsyncFFWebServer::formatPushValues(const bool all) {
+	String text;
+	for (ffPushValue_t &item : pushValues) {
+		if (all || item.dirty) {
+			text += item.name;
+			text += '|';
+			text += item.value;
+			text += '|';
+			text += item.type;
+			text += '\n';
+		}
+		if (!all) {
+			item.dirty = false;
+		}
+	}
+	return text;
+}
+
+// Send changed values to /events clients (called by handle())
+void AsyncFFWebServer::servicePushValues(void) {
+	if (!pushValuesDirty || (millis() - pushValuesLastSend) < FF_PUSH_VALUES_INTERVAL) {
+		return;
+	}
+	pushValuesLastSend = millis();
+	pushValuesDirty = false;
+	String text = formatPushValues(false);
+	// New clients will get all values at connection
+	if (_evs.count() > 0) {
+		_evs.send(text.c_str(), "values", millis());
+	}
+}
+
+/*!
+
+	Bind a value to /rest/values, /json/values, MQTT and index.htm
+
+	Server keeps value address, and formats value itself when needed:
+		- in /rest/values (if not answered by REST command callback), after standard header, if FF_BIND_REST is set,
+		- in /json/values (if not answered by JSON command callback), if FF_BIND_JSON is set,
+		- as MQTT <topic>/<name> message, when value changes, if FF_BIND_MQTT is set,
+		- pushed to index.htm, when value changes, if FF_BIND_PUSH is set.
+	Numeric values are only published when they change by more than deadband.
+
+	\param[in]	name: value name (HTML element id, JSON key and MQTT subtopic). Should stay valid (literal)
+	\param[in]	value: address of value. Should stay valid (global or static)
+	\param[in]	flags: FF_BIND_xxx flags (default to FF_BIND_ALL)
+	\param[in]	format: printf format of text (/rest/values, MQTT and index.htm), default to %d, %ld, %lu or %.2f
+	\param[in]	deadband: minimum change of value to publish it
+	\return	None
+
+*/
+void AsyncFFWebServer::bindValue(const char *name, const int *value, const uint8_t flags, const char *format, const float deadband) {
+	addBoundValue(name, value, FF_BIND_INT, flags, format, deadband);
+}
+
+// Bind a long value
+void AsyncFFWebServer::bindValue(const char *name, const long *value, const uint8_t flags, const char *format, const float deadband) {
+	addBoundValue(name, value, FF_BIND_LONG, flags, format, deadband);
+}
+
+// Bind an unsigned long value
+void AsyncFFWebServer::bindValue(const char *name, const unsigned long *value, const uint8_t flags, const char *format, const float deadband) {
+	addBoundValue(name, value, FF_BIND_ULONG, flags, format, deadband);
+}
+
+// Bind a float value
+void AsyncFFWebServer::bindValue(const char *name, const float *value, const uint8_t flags, const char *format, const float deadband) {
+	addBoundValue(name, value, FF_BIND_FLOAT, flags, format, deadband);
+}
+
+// Bind a bool value (sent as 1 or 0, true or false in JSON)
+void AsyncFFWebServer::bindValue(const char *name, const bool *value, const uint8_t flags) {
+	addBoundValue(name, value, FF_BIND_BOOL, flags, NULL, 0);
+}
+
+// Bind a char array value
+void AsyncFFWebServer::bindValue(const char *name, const char *value, const uint8_t flags) {
+	addBoundValue(name, value, FF_BIND_CHARS, flags, NULL, 0);
+}
+
+// Bind a String value
+void AsyncFFWebServer::bindValue(const char *name, const String *value, const uint8_t flags) {
+	addBoundValue(name, value, FF_BIND_STRING, flags, NULL, 0);
+}
+
+// Add or replace a value binding
+void AsyncFFWebServer::addBoundValue(const char *name, const void *value, const ffBindType_t type, const uint8_t flags, const char *format, const float deadband) {
+	ffBoundValue_t binding = {name, value, type, flags, format, deadband, 0, String(), false, false};
+	for (ffBoundValue_t &item : boundValues) {
+		if (!strcmp(item.name, name)) {
+			item = binding;
+			return;
+		}
+	}
+	boundValues.push_back(binding);
+}
+
+// Return numeric value of a bound value
+double AsyncFFWebServer::numericBoundValue(const ffBoundValue_t &binding) {
+	switch (binding.type) {
+		case FF_BIND_INT:
+			return *(const int *) binding.value;
+		case FF_BIND_LONG:
+			return *(const long *) binding.value;
+		case FF_BIND_ULONG:
+			return *(const unsigned long *) binding.value;
+		case FF_BIND_FLOAT:
+			return *(const float *) binding.value;
+		case FF_BIND_BOOL:
+			return *(const bool *) binding.value;
+		default:
+			return 0;
+	}
+}
+
+// Format a bound value as text
+String AsyncFFWebServer::formatBoundValue(const ffBoundValue_t &binding) {
+	char buffer[32];
+	switch (binding.type) {
+		case FF_BIND_INT:
+			snprintf(buffer, sizeof(buffer), binding.format ? binding.format : "%d", *(const int *) binding.value);
+			break;
+		case FF_BIND_LONG:
+			snprintf(buffer, sizeof(buffer), binding.format ? binding.format : "%ld", *(const long *) binding.value);
+			break;
+		case FF_BIND_ULONG:
+			snprintf(buffer, sizeof(buffer), binding.format ? binding.format : "%lu", *(const unsigned long *) binding.value);
+			break;
+		case FF_BIND_FLOAT:
+			snprintf(buffer, sizeof(buffer), binding.format ? binding.format : "%.2f", *(const float *) binding.value);
+			break;
+		case FF_BIND_BOOL:
+			return *(const bool *) binding.value ? F("1") : F("0");
+		case FF_BIND_CHARS:
+			return String((const char *) binding.value);
+		case FF_BIND_STRING:
+			return *(const String *) binding.value;
+	}
+	return String(buffer);
+}
+
+// Check if a bound value changed since last publication
+bool AsyncFFWebServer::boundValueChanged(const ffBoundValue_t &binding) {
+	if (!binding.published) {
+		return true;
+	}
+	switch (binding.type) {
+		case FF_BIND_CHARS:
+			return strcmp((const char *) binding.value, binding.lastText.c_str()) != 0;
+		case FF_BIND_STRING:
+			return *(const String *) binding.value != binding.lastText;
+		default:
+			double delta = numericBoundValue(binding) - binding.lastValue;
+			if (binding.deadband > 0) {
+				return fabs(delta) >= binding.deadband;
+			}
+			return delta != 0;
+	}
+}
+
+// Publish bound values changed since last check on MQTT and index.htm (called by handle())
+void AsyncFFWebServer::serviceBoundValues(void) {
+	if (boundValues.empty() || (millis() - boundValuesLastCheck) < FF_BIND_CHECK_INTERVAL) {
+		return;
+	}
+	boundValuesLastCheck = millis();
+	for (ffBoundValue_t &binding : boundValues) {
+		if (!(binding.flags & (FF_BIND_MQTT | FF_BIND_PUSH))) {
+			continue;
+		}
+		bool changed = boundValueChanged(binding);
+		if (!changed && !binding.mqttPending) {
+			continue;
+		}
+		String text = formatBoundValue(binding);
+		if (changed) {
+			if (binding.flags & FF_BIND_PUSH) {
+				pushValue(binding.name, text, (binding.flags & FF_BIND_INPUT) ? "input" : "div");
+			}
+			binding.mqttPending = (binding.flags & FF_BIND_MQTT) != 0;
+			binding.lastValue = numericBoundValue(binding);
+			binding.lastText = text;
+			binding.published = true;
+		}
+		// MQTT publication waits for connection, sending last value
+		if (binding.mqttPending && mqttClient.connected()) {
+			mqttPublish(binding.name, text.c_str());
+			binding.mqttPending = false;
+		}
+	}
+}
+
+// Send bound values in /rest/values, after standard header. Returns false if no value is bound
+bool AsyncFFWebServer::sendBoundValuesRest(AsyncWebServerRequest *request) {
+	bool found = false;
+	for (const ffBoundValue_t &binding : boundValues) {
+		found = found || (binding.flags & FF_BIND_REST);
+	}
+	if (!found) {
+		return false;
+	}
+	char header[100];
+	snprintf_P(header, sizeof(header), PSTR("%s V%s/%s, up since %s"),
+		getDeviceName().c_str(), userVersion.c_str(), serverVersion.c_str(), NTP.getUptimeString().c_str());
+	FF_ValuesResponse values(request);
+	values.add(PSTR("header"), header);
+	for (const ffBoundValue_t &binding : boundValues) {
+		if (binding.flags & FF_BIND_REST) {
+			values.add(binding.name, formatBoundValue(binding), (binding.flags & FF_BIND_INPUT) ? "input" : "div");
+		}
+	}
+	values.send();
+	return true;
+}
+
+// Send bound values in /json/values. Returns false if no value is bound
+bool AsyncFFWebServer::sendBoundValuesJson(AsyncWebServerRequest *request) {
+	JsonDocument jsonDoc;
+	for (const ffBoundValue_t &binding : boundValues) {
+		if (!(binding.flags & FF_BIND_JSON)) {
+			continue;
+		}
+		// Numbers are sent as JSON numbers (format is only used for text), NaN and infinite floats as null
+		switch (binding.type) {
+			case FF_BIND_INT:
+				jsonDoc[binding.name] = *(const int *) binding.value;
+				break;
+			case FF_BIND_LONG:
+				jsonDoc[binding.name] = *(const long *) binding.value;
+				break;
+			case FF_BIND_ULONG:
+				jsonDoc[binding.name] = *(const unsigned long *) binding.value;
+				break;
+			case FF_BIND_FLOAT: {
+				float value = *(const float *) binding.value;
+				if (isfinite(value)) {
+					jsonDoc[binding.name] = value;
+				} else {
+					jsonDoc[binding.name] = nullptr;
+				}
+				break;
+			}
+			case FF_BIND_BOOL:
+				jsonDoc[binding.name] = *(const bool *) binding.value;
+				break;
+			case FF_BIND_CHARS:
+			case FF_BIND_STRING:
+				jsonDoc[binding.name] = formatBoundValue(binding);
+				break;
+		}
+	}
+	if (jsonDoc.isNull()) {
+		return false;
+	}
+	String body;
+	serializeJson(jsonDoc, body);
+	sendResponse(request, "application/json", body);
+	return true;
+}
+
+// Send cached Wi-Fi scan results as JSON, asking for a new scan if they're too old
+void AsyncFFWebServer::send_wifi_scan_json(AsyncWebServerRequest *request) {
+	requestWifiScan();
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	// Count written bytes for metrics
+	FF_TeePrint out;
+	out.output = response;
+	out.print('[');
+	for (size_t i = 0; i < wifiNetworks.size(); i++) {
+		const ffWifiNetwork_t &network = wifiNetworks[i];
+		out.printf_P(PSTR("%s{\"rssi\":%d,\"ssid\":\"%s\",\"bssid\":\"%s\",\"channel\":%u,\"secure\":%u,\"hidden\":%s}"),
+			i ? "," : "", network.rssi, network.ssid.c_str(), network.bssid.c_str(), network.channel, network.encryption, network.hidden ? "true" : "false");
+	}
+	out.print(']');
+	// Give age of results, in seconds
+	response->addHeader("X-Scan-Age", String(wifiScanTime ? (millis() - wifiScanTime) / 1000 : 0));
+	metricsResponse(200, out.count);
+	request->send(response);
+}
+
+/*!
+
+	Ask for a Wi-Fi networks scan
+
+	Scan is started in background by handle(), only if last one is older than scan interval.
+		This allows multiple pages (or tabs) to ask for a scan, without scanning at each request.
+
+	\param	None
+	\return	None
+
+*/
+void AsyncFFWebServer::requestWifiScan(void) {
+	wifiScanRequested = true;
+}
+
+/*!
+
+	Register a route
+
+	Routes are kept in a tree of path segments, so finding the route of a request mainly depends on URL length,
+		fixed texts of a path position being found by a binary search on their hash.
+	Pattern segments may be:
+		- a fixed text (i.e. /rest/relay),
+		- a {name} parameter, matching any segment,
+		- a {name:int} parameter, matching only integer segments,
+		- a * as last segment, matching rest of path (even empty), given as "*" parameter.
+	A fixed text is preferred to a parameter when both match.
+	Authentication policy is attached to route. Routes registered with FF_AUTH_INHERIT use policy of their path,
+		given by first route registered on path or on shorter paths (FF_AUTH_REQUIRED if one of them requires authentication).
+	Requests are counted in /admin/metrics (answers with their status when sent by sendResponse() or FF_ValuesResponse),
+		and subject to admission control and rate limit.
+
+	\param[in]	pattern: route pattern (i.e. /rest/relay/{id:int}). Should stay valid (literal)
+	\param[in]	method: accepted methods (HTTP_GET, HTTP_POST, HTTP_GET | HTTP_POST, HTTP_ANY...)
+	\param[in]	auth: FF_AUTH_REQUIRED, FF_AUTH_NONE or FF_AUTH_INHERIT
+	\param[in]	routeCallback: routine called with request and path parameters
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::route(const char *pattern, const WebRequestMethodComposite method, const ffAuthPolicy_t auth, ROUTE_CALLBACK_SIGNATURE) {
+	if (routeNodes.empty()) {
+		addRouteNode(0, "", 0);
+	}
+	uint16_t node = 0;
+	const char *position = pattern;
+	while (*position) {
+		if (*position == '/') {
+			position++;
+			continue;
+		}
+		const char *end = strchr(position, '/');
+		if (!end) {
+			end = position + strlen(position);
+		}
+		node = addRouteNode(node, position, end - position);
+		position = end;
+	}
+	// Keep path policy for inheritance, authentication required as soon as one route of path requires it
+	if (auth != FF_AUTH_INHERIT && routeNodes[node].auth != FF_AUTH_REQUIRED) {
+		routeNodes[node].auth = auth;
+	}
+	uint16_t index = routes.size();
+	ffRoute_t item;
+	item.method = method;
+	item.auth = auth;
+	item.routeCallback = routeCallback;
+	item.metered = metered(pattern, [this, index](AsyncWebServerRequest *request) {
+		if (this->currentRouteAuth == FF_AUTH_REQUIRED && !this->checkAuth(request))
+			return this->requestAuth(request);
+		this->routes[index].routeCallback(request, this->currentRouteParams);
+	});
+	routes.push_back(item);
+	routeNodes[node].routes.push_back(index);
+	return *this;
+}
+
+/*!
+
+	Keep a request header for user's code
+
+	To save memory, only headers used by FF_WebServer (and those asked by other handlers) are kept in requests.
+		Callbacks reading other headers (i.e. User-Agent) should ask to keep them.
+
+	\param[in]	name: header name. Should stay valid (literal)
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::keepRequestHeader(const char *name) {
+	keptHeaders.push_back(name);
+	return *this;
+}
+
+// Return child node of a parent matching a pattern segment, creating it if needed
+uint16_t AsyncFFWebServer::addRouteNode(const uint16_t parent, const char *segment, const size_t length) {
+	ffRouteNode_t node;
+	node.kind = FF_ROUTE_LITERAL;
+	node.segment.concat(segment, length);
+	if (length == 1 && *segment == '*') {
+		node.kind = FF_ROUTE_TAIL;
+		node.segment = "*";
+	} else if (length > 2 && *segment == '{' && segment[length - 1] == '}') {
+		node.kind = FF_ROUTE_TEXT;
+		node.segment = node.segment.substring(1, length - 1);
+		if (node.segment.endsWith(":int")) {
+			node.kind = FF_ROUTE_INT;
+			node.segment.remove(node.segment.length() - 4);
+		}
+	}
+	node.hash = bufferHash(node.segment.c_str(), node.segment.length());
+	node.auth = FF_AUTH_INHERIT;
+	node.paramChild = -1;
+	node.tailChild = -1;
+	if (routeNodes.empty()) {
+		routeNodes.push_back(node);
+		return 0;
+	}
+	// Return existing node
+	size_t position = findRouteChild(routeNodes[parent].children, node.hash);
+	if (node.kind == FF_ROUTE_LITERAL) {
+		const std::vector<uint16_t> &children = routeNodes[parent].children;
+		for (; position < children.size() && routeNodes[children[position]].hash == node.hash; position++) {
+			if (routeNodes[children[position]].segment == node.segment) {
+				return children[position];
+			}
+		}
+	} else if (node.kind == FF_ROUTE_TAIL) {
+		if (routeNodes[parent].tailChild >= 0) {
+			return routeNodes[parent].tailChild;
+		}
+	} else if (routeNodes[parent].paramChild >= 0) {
+		// Only one parameter per path position, first definition is kept
+		uint16_t child = routeNodes[parent].paramChild;
+		if (routeNodes[child].segment != node.segment || routeNodes[child].kind != node.kind) {
+			DEBUG_ERROR_P("Route parameter {%s} conflicts with {%s}", node.segment.c_str(), routeNodes[child].segment.c_str());
+		}
+		return child;
+	}
+	uint16_t index = routeNodes.size();
+	routeNodes.push_back(node);
+	if (node.kind == FF_ROUTE_LITERAL) {
+		// Keep children sorted on hash (position is after nodes with same hash)
+		routeNodes[parent].children.insert(routeNodes[parent].children.begin() + position, index);
+	} else if (node.kind == FF_ROUTE_TAIL) {
+		routeNodes[parent].tailChild = index;
+	} else {
+		routeNodes[parent].paramChild = index;
+	}
+	return index;
+}
+
+// Return position of first child node with a hash greater or equal to a given one (children are sorted on hash)
+size_t AsyncFFWebServer::findRouteChild(const std::vector<uint16_t> &children, const uint32_t hash) {
+	size_t low = 0;
+	size_t high = children.size();
+	while (low < high) {
+		size_t middle = (low + high) / 2;
+		if (routeNodes[children[middle]].hash < hash) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+// Return node matching an URL (-1 if none), loading path parameters and authentication policy
+int AsyncFFWebServer::matchRoute(const String &url, FF_RouteParams &params, ffAuthPolicy_t &auth) {
+	params._count = 0;
+	auth = FF_AUTH_NONE;
+	if (routeNodes.empty()) {
+		return -1;
+	}
+	int node = 0;
+	// Last tail node seen, used if path doesn't fully match
+	int tailNode = -1;
+	const char *tailStart = NULL;
+	uint8_t tailCount = 0;
+	ffAuthPolicy_t tailAuth = FF_AUTH_NONE;
+	const char *position = url.c_str();
+	while (node >= 0) {
+		const ffRouteNode_t *current = &routeNodes[node];
+		if (current->auth != FF_AUTH_INHERIT) {
+			auth = current->auth;
+		}
+		while (*position == '/') {
+			position++;
+		}
+		if (current->tailChild >= 0) {
+			tailNode = current->tailChild;
+			tailStart = position;
+			tailCount = params._count;
+			tailAuth = auth;
+		}
+		if (!*position) {
+			break;
+		}
+		const char *end = strchr(position, '/');
+		if (!end) {
+			end = position + strlen(position);
+		}
+		size_t length = end - position;
+		uint32_t hash = bufferHash(position, length);
+		int next = -1;
+		for (size_t i = findRouteChild(current->children, hash); i < current->children.size(); i++) {
+			const ffRouteNode_t *candidate = &routeNodes[current->children[i]];
+			if (candidate->hash != hash) {
+				break;
+			}
+			if (candidate->segment.length() == length && !memcmp(candidate->segment.c_str(), position, length)) {
+				next = current->children[i];
+				break;
+			}
+		}
+		if (next < 0 && current->paramChild >= 0) {
+			const ffRouteNode_t *candidate = &routeNodes[current->paramChild];
+			bool valid = true;
+			if (candidate->kind == FF_ROUTE_INT) {
+				for (size_t i = (*position == '-') ? 1 : 0; i < length && valid; i++) {
+					valid = isDigit(position[i]);
+				}
+				valid = valid && length > ((*position == '-') ? 1U : 0U);
+			}
+			if (valid && params._count < FF_ROUTE_MAX_PARAMS) {
+				params.add(candidate->segment.c_str(), position, length);
+				next = current->paramChild;
+			}
+		}
+		node = next;
+		position = end;
+	}
+	if (node >= 0 && !routeNodes[node].routes.empty()) {
+		return node;
+	}
+	if (tailNode >= 0) {
+		params._count = tailCount;
+		params.add("*", tailStart, strlen(tailStart));
+		auth = (routeNodes[tailNode].auth != FF_AUTH_INHERIT) ? routeNodes[tailNode].auth : tailAuth;
+		return tailNode;
+	}
+	return -1;
+}
+
+// Return route matching request URL and method (-1 if none), loading path parameters and authentication policy
+int AsyncFFWebServer::findRoute(AsyncWebServerRequest *request, FF_RouteParams &params, ffAuthPolicy_t &auth) {
+	int node = matchRoute(request->url(), params, auth);
+	if (node < 0) {
+		return -1;
+	}
+	for (uint16_t index : routeNodes[node].routes) {
+		if (routes[index].method & request->method()) {
+			// Route policy, else the one inherited from path
+			if (routes[index].auth != FF_AUTH_INHERIT) {
+				auth = routes[index].auth;
+			}
+			return index;
+		}
+	}
+	return -1;
+}
+
+// Check if a route matches request
+bool FF_RouteHandler::canHandle(AsyncWebServerRequest *request) {
+	// This handler sees all requests first, keep headers used by FF_WebServer (others are removed after handler selection)
+	request->addInterestingHeader("Cookie");
+	request->addInterestingHeader("If-None-Match");
+	request->addInterestingHeader("Range");
+	request->addInterestingHeader("If-Range");
+	request->addInterestingHeader("Authorization");
+	if (!server) {
+		return false;
+	}
+	// Keep also headers asked by user's code (other handlers ask for their own headers)
+	for (const char *name : server->keptHeaders) {
+		request->addInterestingHeader(name);
+	}
+	if (request->hasHeader("Upgrade") || (request->hasHeader("Accept") && request->header("Accept").indexOf("text/event-stream") >= 0)) {
+		// Client will be taken over by a web socket or event source, which deletes request without disconnecting it: stop supervising it
+		server->releaseConnection(request->client());
+	} else {
+		// Headers have been received, connection now waits for body (if any)
+		server->connectionActivity(request, FF_CONN_BODY);
+	}
+	// Keep result for handleRequest() (canHandle() is called for each request, so an older one is never kept)
+	lastRequest = request;
+	lastIndex = server->findRoute(request, lastParams, lastAuth);
+	return lastIndex >= 0;
+}
+
+// Execute route matching request
+void FF_RouteHandler::handleRequest(AsyncWebServerRequest *request) {
+	int index;
+	if (request == lastRequest) {
+		index = lastIndex;
+		server->currentRouteParams = lastParams;
+		server->currentRouteAuth = lastAuth;
+		lastRequest = NULL;
+	} else {
+		// Another request was checked since this one
+		index = server->findRoute(request, server->currentRouteParams, server->currentRouteAuth);
+	}
+	if (index < 0) {
+		server->error404(request);
+		return;
+	}
+	server->routes[index].metered(request);
+}
+
+/*!
+
+	Cache responses of an URL
+
+	Last response to a /rest or /json URL is kept in RAM during given time, and sent again
+		to GET requests for the same URL (without parameters) without calling REST or JSON command callback.
+		Other methods always call command callback, and their responses are not cached.
+		Only responses written by FF_ValuesResponse or sendResponse() are cached.
+	Total size of cached responses is limited to FF_RESPONSE_CACHE_SIZE, oldest ones are removed first.
+
+	\param[in]	url: URL to cache (i.e. /rest/values)
+	\param[in]	ttl: time to keep response (ms), 0 to stop caching URL
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::setResponseCache(const char *url, const unsigned long ttl) {
+	uint8_t i;
+	// Update existing URL, else add it
+	for (i = 0; i < cachedResponseCount; i++) {
+		if (cachedResponses[i].url == url) {
+			break;
+		}
+	}
+	if (i >= FF_RESPONSE_CACHE_RULES) {
+		DEBUG_ERROR_P("Too many cached URLs, %s ignored", url);
+		return *this;
+	}
+	cachedResponses[i].url = url;
+	cachedResponses[i].ttl = ttl;
+	cachedResponses[i].body = String();
+	if (i == cachedResponseCount) {
+		cachedResponseCount++;
+	}
+	return *this;
+}
+
+/*!
+
+	Send a response, keeping it in response cache if its URL is cached
+
+	To be used by REST or JSON command callbacks instead of request->send(200, contentType, body).
+
+	\param[in]	request: request to answer
+	\param[in]	contentType: content type of response
+	\param[in]	body: response content
+	\return	None
+
+*/
+void AsyncFFWebServer::sendResponse(AsyncWebServerRequest *request, const char *contentType, const String &body) {
+	sendResponse(request, 200, contentType, body);
+}
+
+/*!
+
+	Send a response with a given status code, counting it in request metrics
+
+	Only 200 responses are kept in response cache.
+
+	\param[in]	request: request to answer
+	\param[in]	code: HTTP status code
+	\param[in]	contentType: content type of response
+	\param[in]	body: response content
+	\return	None
+
+*/
+void AsyncFFWebServer::sendResponse(AsyncWebServerRequest *request, const int code, const char *contentType, const String &body) {
+	if (code == 200) {
+		storeCachedResponse(request, contentType, body);
+	}
+	metricsResponse(code, body.length());
+	request->send(code, contentType, body);
+}
+
+// Return cache entry of request URL, NULL if not cached (or request is not a GET or has parameters)
+ffCachedResponse_t *AsyncFFWebServer::findCachedResponse(AsyncWebServerRequest *request) {
+	if (!cachedResponseCount || request->method() != HTTP_GET || request->args()) {
+		return NULL;
+	}
+	for (uint8_t i = 0; i < cachedResponseCount; i++) {
+		if (cachedResponses[i].ttl && cachedResponses[i].url == request->url()) {
+			return &cachedResponses[i];
+		}
+	}
+	return NULL;
+}
+
+// Check if response to a request should be cached
+bool AsyncFFWebServer::isResponseCached(AsyncWebServerRequest *request) {
+	return findCachedResponse(request) != NULL;
+}
+
+// Keep a response in cache if its URL is cached, removing oldest responses if cache is full
+void AsyncFFWebServer::storeCachedResponse(AsyncWebServerRequest *request, const char *contentType, const String &body) {
+	ffCachedResponse_t *entry = findCachedResponse(request);
+	if (!entry) {
+		return;
+	}
+	entry->body = String();
+	if (body.length() > FF_RESPONSE_CACHE_SIZE) {
+		return;
+	}
+	while (true) {
+		size_t used = 0;
+		ffCachedResponse_t *oldest = NULL;
+		for (uint8_t i = 0; i < cachedResponseCount; i++) {
+			if (cachedResponses[i].body.length()) {
+				used += cachedResponses[i].body.length();
+				if (!oldest || (millis() - cachedResponses[i].time) > (millis() - oldest->time)) {
+					oldest = &cachedResponses[i];
+				}
+			}
+		}
+		if (used + body.length() <= FF_RESPONSE_CACHE_SIZE) {
+			break;
+		}
+		oldest->body = String();
+	}
+	entry->contentType = contentType;
+	entry->body = body;
+	entry->time = millis();
+}
+
+// Send cached response of request URL if still valid
+bool AsyncFFWebServer::sendCachedResponse(AsyncWebServerRequest *request) {
+	ffCachedResponse_t *entry = findCachedResponse(request);
+	if (!entry) {
+		return false;
+	}
+	if (!entry->body.length() || (millis() - entry->time) >= entry->ttl) {
+		responseCacheMisses++;
+		return false;
+	}
+	responseCacheHits++;
+	metricsResponse(200, entry->body.length());
+	AsyncWebServerResponse *response = request->beginResponse(200, entry->contentType, entry->body);
+	response->addHeader("X-Cache", "HIT");
+	request->send(response);
+	return true;
+}
+
+/*!
+
+	Set admission limits
+
+	Non critical requests are rejected with a 503 answer and a Retry-After header when free heap or largest
+		free block is lower than given limits, or when too many requests are in progress.
+	/admin/restart, /admin/metrics and OTA update URLs are always admitted.
+
+	\param[in]	minHeap: minimum free heap to admit a request (bytes)
+	\param[in]	minBlock: minimum largest free block to admit a request (bytes)
+	\param[in]	maxInFlight: maximum number of requests in progress to admit a new one
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::setAdmissionLimits(const uint32_t minHeap, const uint32_t minBlock, const uint8_t maxInFlight) {
+	admissionMinHeap = minHeap;
+	admissionMinBlock = minBlock;
+	admissionMaxInFlight = maxInFlight;
+	return *this;
+}
+
+/*!
+
+	Set connection timeouts
+
+	Connections are closed when request headers are not received within headerTimeout after connection,
+		when no request body data is received during bodyTimeout, or when client doesn't acknowledge
+		answer data during writeTimeout. Event source (/events) connections are not supervised.
+
+	\param[in]	headerTimeout: maximum time to receive request headers (ms)
+	\param[in]	bodyTimeout: maximum time without receiving request body data (ms)
+	\param[in]	writeTimeout: maximum time without sent data acknowledgment (ms)
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::setConnectionTimeouts(const unsigned long headerTimeout, const unsigned long bodyTimeout, const unsigned long writeTimeout) {
+	connHeaderTimeout = headerTimeout;
+	connBodyTimeout = bodyTimeout;
+	connWriteTimeout = writeTimeout;
+	return *this;
+}
+
+/*!
+
+	Set minimum interval between two Wi-Fi scans
+
+	\param[in]	interval: minimum interval (in ms) between two scans
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::setWifiScanInterval(const unsigned long interval) {
+	wifiScanInterval = interval;
+	return *this;
+}
+
+// Start requested Wi-Fi scan and load its results when complete (called by handle())
+void AsyncFFWebServer::serviceWifiScan(void) {
+	if (wifiScanRunning) {
+		int count = WiFi.scanComplete();
+		if (count == WIFI_SCAN_RUNNING) {
+			return;
+		}
+		wifiScanRunning = false;
+		if (count < 0) {
+			DEBUG_ERROR_P("Wi-Fi scan failed", NULL);
+			return;
+		}
+		wifiNetworks.clear();
+		wifiNetworks.reserve(count);
+		for (int i = 0; i < count; i++) {
+			ffWifiNetwork_t network;
+			network.ssid = WiFi.SSID(i);
+			network.bssid = WiFi.BSSIDstr(i);
+			network.rssi = WiFi.RSSI(i);
+			network.channel = WiFi.channel(i);
+			network.encryption = WiFi.encryptionType(i);
+			network.hidden = WiFi.isHidden(i);
+			wifiNetworks.push_back(network);
+		}
+		WiFi.scanDelete();
+		wifiScanTime = millis();
+		DEBUG_VERBOSE_P("Wi-Fi scan found %d networks", count);
+		return;
+	}
+	// Start a new scan only if requested and last one is old enough
+	if (wifiScanRequested && (!wifiScanStart || (millis() - wifiScanStart) >= wifiScanInterval)) {
+		wifiScanRequested = false;
+		wifiScanStart = millis();
+		if (WiFi.scanNetworks(true) == WIFI_SCAN_RUNNING) {
+			wifiScanRunning = true;
+		}
+	}
+}
+
+// Send information data
+void AsyncFFWebServer::send_information_values_html(AsyncWebServerRequest *request) {
+	FF_ValuesResponse values(request);
+	values.add(PSTR("x_ssid"), WiFi.SSID())
+		.add(PSTR("x_ip"), WiFi.localIP())
+		.add(PSTR("x_gateway"), WiFi.gatewayIP())
+		.add(PSTR("x_netmask"), WiFi.subnetMask())
+		.add(PSTR("x_mac"), getMacAddress())
+		.add(PSTR("x_dns"), WiFi.dnsIP())
+		.add(PSTR("x_ntp_sync"), NTP.getTimeDateString(NTP.getLastNTPSync()))
+		.add(PSTR("x_ntp_time"), NTP.getTimeStr())
+		.add(PSTR("x_ntp_date"), NTP.getDateStr())
+		.add(PSTR("x_uptime"), NTP.getUptimeString())
+		.add(PSTR("x_last_boot"), NTP.getTimeDateString(NTP.getLastBootTime()))
+		.send();
+}
+
+// Get ESP8266 MAC address
+String AsyncFFWebServer::getMacAddress() {
+	uint8_t mac[6];
+	char macStr[18] = { 0 };
+	WiFi.macAddress(mac);
+	sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	return String(macStr);
+}
+
+// Send NTP configuration data
+void AsyncFFWebServer::send_NTP_configuration_values_html(AsyncWebServerRequest *request) {
+	FF_ValuesResponse values(request);
+	values.add(PSTR("ntpserver"), _config.ntpServerName, PSTR("input"))
+		.add(PSTR("update"), _config.updateNTPTimeEvery, PSTR("input"))
+		.add(PSTR("tz"), _config.timezone, PSTR("input"))
+		.addChecked(PSTR("dst"), _config.daylight)
+		.send();
+}
+
+// Convert a single hex digit character to its integer value (from https://code.google.com/p/avr-netino/)
+unsigned char AsyncFFWebServer::h2int(char c) {
+	if (c >= '0' && c <= '9') {
+		return((unsigned char)c - '0');
+	}
+	if (c >= 'a' && c <= 'f') {
+		return((unsigned char)c - 'a' + 10);
+	}
+	if (c >= 'A' && c <= 'F') {
+		return((unsigned char)c - 'A' + 10);
+	}
+	return(0);
+}
+
+// Decode an URL (replace + by space and %xx by its ascii hexa code
+String AsyncFFWebServer::urldecode(String input) {		// (based on https://code.google.com/p/avr-netino/) {
+	char c;
+	String ret = "";
+
+	for (byte t = 0; t < input.length(); t++) {
+		c = input[t];
+		if (c == '+') c = ' ';
+		if (c == '%') {
+			t++;
+			c = input[t];
+			t++;
+			c = (h2int(c) << 4) | h2int(input[t]);
+		}
+		ret.concat(c);
+	}
+	return ret;
+
+}
+
+// Check the Values is between 0-255
+boolean AsyncFFWebServer::checkRange(String Value) {
+	if (Value.toInt() < 0 || Value.toInt() > 255) {
+		return false;
+	} else {
+		return true;
+	}
+}
+
+//	Send network configuration data
 void AsyncFFWebServer::send_network_configuration_html(AsyncWebServerRequest *request) {
 	if (request->args() > 0) { // Save Settings
 		//String temp = "";
@@ -1683,6 +3957,7 @@ void AsyncFFWebServer::send_network_configuration_html(AsyncWebServerRequest *re
 			if (request->argName(i) == "dns_3") { if (checkRange(request->arg(i))) 	_config.dns[3] = request->arg(i).toInt(); continue; }
 			if (request->argName(i) == "dhcp") { _config.dhcp = true; continue; }
 		}
+		metricsResponse(200, strlen_P(Page_WaitAndReload));
 		request->send_P(200, "text/html", Page_WaitAndReload);
 		save_config();
 		//yield();
@@ -1700,7 +3975,7 @@ void AsyncFFWebServer::send_network_configuration_html(AsyncWebServerRequest *re
 //	Send general configuration data
 void AsyncFFWebServer::send_general_configuration_html(AsyncWebServerRequest *request) {
 	if (!checkAuth(request))
-		return request->requestAuthentication();
+		return requestAuth(request);
 
 	if (request->args() > 0) {// Save Settings
 		for (uint8_t i = 0; i < request->args(); i++) {
@@ -1710,6 +3985,7 @@ void AsyncFFWebServer::send_general_configuration_html(AsyncWebServerRequest *re
 				continue;
 			}
 		}
+		metricsResponse(200, strlen_P(Page_Restart));
 		request->send_P(200, "text/html", Page_Restart);
 		save_config();
 		_fs->end();
@@ -1723,7 +3999,7 @@ void AsyncFFWebServer::send_general_configuration_html(AsyncWebServerRequest *re
 void AsyncFFWebServer::send_NTP_configuration_html(AsyncWebServerRequest *request) {
 
 	if (!checkAuth(request))
-		return request->requestAuthentication();
+		return requestAuth(request);
 
 	if (request->args() > 0) {// Save Settings
 		_config.daylight = false;
@@ -1763,6 +4039,7 @@ void AsyncFFWebServer::send_NTP_configuration_html(AsyncWebServerRequest *reques
 
 // Restart ESP
 void AsyncFFWebServer::restart_esp(AsyncWebServerRequest *request) {
+	metricsResponse(200, strlen_P(Page_Restart));
 	request->send_P(200, "text/html", Page_Restart);
 	_fs->end(); // LitleFS.end();
 	delay(1000);
@@ -1771,12 +4048,11 @@ void AsyncFFWebServer::restart_esp(AsyncWebServerRequest *request) {
 
 // Send authentication data
 void AsyncFFWebServer::send_wwwauth_configuration_values_html(AsyncWebServerRequest *request) {
-	String values = 
-		  PSTR("wwwauth|") + (String)(_httpAuth.auth ? PSTR("checked") : "") + PSTR("|chk\n")
-		+ PSTR("wwwuser|") + (String)_httpAuth.wwwUsername + PSTR("|input\n")
-		+ PSTR("wwwpass|") + (String)_httpAuth.wwwPassword + PSTR("|input\n");
-
-	request->send(200, "text/plain", values);
+	FF_ValuesResponse values(request);
+	values.addChecked(PSTR("wwwauth"), _httpAuth.auth)
+		.add(PSTR("wwwuser"), _httpAuth.wwwUsername, PSTR("input"))
+		.add(PSTR("wwwpass"), _httpAuth.wwwPassword, PSTR("input"))
+		.send();
 }
 
 // Set authentication data
@@ -1817,24 +4093,16 @@ bool AsyncFFWebServer::saveHTTPAuth() {
 	jsonDoc["auth"] = _httpAuth.auth;
 	jsonDoc["user"] = _httpAuth.wwwUsername;
 	jsonDoc["pass"] = _httpAuth.wwwPassword;
+	// Sessions opened with previous settings are no longer valid
+	clearSessions();
 
 	//TODO add AP data to html
-	File configFile = _fs->open(SECRET_FILE, "w");
-	if (!configFile) {
-		DEBUG_ERROR_P("Failed to open %s for writing", SECRET_FILE);
-		configFile.close();
-		return false;
-	}
-
 	#ifdef DEBUG_FF_WEBSERVER
 		String temp;
 		serializeJsonPretty(jsonDoc, temp);
 		DEBUG_VERBOSE_P("Secret %s", temp.c_str());
 	#endif // DEBUG_FF_WEBSERVER
-	serializeJson(jsonDoc, configFile);
-	configFile.flush();
-	configFile.close();
-	return true;
+	return writeConfigFile(SECRET_FILE, jsonDoc);
 }
 
 // Check for firmware update capacity
@@ -1842,19 +4110,19 @@ void AsyncFFWebServer::send_update_firmware_values_html(AsyncWebServerRequest *r
 	uint32_t maxSketchSpace = (ESP.getSketchSize() - 0x1000) & 0xFFFFF000;
 	bool updateOK = maxSketchSpace < ESP.getFreeSketchSpace();
 	DEBUG_VERBOSE_P("OTA MaxSketchSpace: %d, free %d", maxSketchSpace, ESP.getFreeSketchSpace());
-	String values = PSTR("remupd|") + (String)((updateOK) ? PSTR("OK") : PSTR("ERROR")) + PSTR("|div\n");
+	FF_ValuesResponse values(request);
+	values.add(PSTR("remupd"), updateOK ? F("OK") : F("ERROR"));
 
 	if (Update.hasError()) {
 		StreamString result;
 		Update.printError(result);
 		result.trim();
 		DEBUG_VERBOSE_P("OTA result :%s", result.c_str());
-		values += PSTR("remupdResult|") + String(result) + PSTR("|div\n");
+		values.add(PSTR("remupdResult"), result);
 	} else {
-		values += PSTR("remupdResult||div\n");
+		values.add(PSTR("remupdResult"), "");
 	}
-
-	request->send(200, "text/plain", values);
+	values.send();
 }
 
 // Set firmware MD5 value
@@ -1874,7 +4142,7 @@ void AsyncFFWebServer::setUpdateMD5(AsyncWebServerRequest *request) {
 				continue;
 			}
 		}
-		request->send(200, "text/html", "OK --> MD5: " + _browserMD5);
+		sendResponse(request, 200, "text/html", "OK --> MD5: " + _browserMD5);
 	}
 
 }
@@ -1928,7 +4196,8 @@ void AsyncFFWebServer::updateFirmware(AsyncWebServerRequest *request, String fil
 // Send user configuration data
 void AsyncFFWebServer::handle_rest_config(AsyncWebServerRequest *request) {
 
-	String values = "";
+	// Values are written directly into response, instead of building a String
+	AsyncResponseStream *response = request->beginResponseStream("text/plain");
 	// handle generic rest call
 	//dirty processing as no split function
 	unsigned int p = 0; //string ptr
@@ -1937,6 +4206,7 @@ void AsyncFFWebServer::handle_rest_config(AsyncWebServerRequest *request) {
 	String name = "";
 	String data = "";
 	String type = "";
+	size_t length = 0;
 
 	while (p < URL.length()) {
 		t = URL.indexOf("/", p);
@@ -1962,10 +4232,90 @@ void AsyncFFWebServer::handle_rest_config(AsyncWebServerRequest *request) {
 		}
 
 		load_user_config(name, data);
-		values += name + "|" + data + "|" + type + "\n";
+		length += response->printf_P(PSTR("%s|%s|%s\n"), name.c_str(), data.c_str(), type.c_str());
+	}
+	metricsResponse(200, length);
+	request->send(response);
+}
+
+// State of a /rconfig.json chunked response
+struct FF_ConfigBundle {
+	String prefix;											// Text sent before user config UI file
+	File uiFile;											// User config UI file, sent as is
+	String suffix;											// Text sent after user config UI file (values)
+	size_t sent = 0;										// Bytes of current text already sent
+	uint8_t step = 0;										// 0: prefix, 1: UI file, 2: suffix, 3: done
+};
+
+/*
+
+	Send user configuration UI and values in one JSON document: {"ui":<userconfigui.json>,"values":<userconfig.json>}
+
+	UI file is streamed as is (without parsing it), values are serialized from user config cache.
+	An ETag is computed from UI file size and date and values content. 304 is returned if browser already has it.
+
+*/
+void AsyncFFWebServer::handle_rest_config_bundle(AsyncWebServerRequest *request) {
+	if (!userConfigLoaded) {
+		readUserConfigFile();
+	}
+	std::shared_ptr<FF_ConfigBundle> bundle = std::make_shared<FF_ConfigBundle>();
+	serializeJson(userConfigDoc, bundle->suffix);
+	uint32_t valuesHash = bufferHash(bundle->suffix.c_str(), bundle->suffix.length());
+	bundle->suffix = String(PSTR(",\"values\":")) + bundle->suffix + PSTR("}");
+
+	uint32_t uiSize = 0;
+	uint32_t uiTime = 0;
+	if (_fs->exists(USER_CONFIG_UI_FILE)) {
+		bundle->uiFile = _fs->open(USER_CONFIG_UI_FILE, "r");
+	}
+	if (bundle->uiFile) {
+		uiSize = bundle->uiFile.size();
+		uiTime = bundle->uiFile.getLastWrite();
+		bundle->prefix = PSTR("{\"ui\":");
+	} else {
+		bundle->prefix = PSTR("{\"ui\":null");
+	}
+
+	char etag[32];
+	snprintf_P(etag, sizeof(etag), PSTR("\"%x-%x-%x\""), uiSize, uiTime, valuesHash);
+	if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+		AsyncWebServerResponse *response = request->beginResponse(304);
+		response->addHeader("ETag", etag);
+		metricsResponse(304);
+		request->send(response);
+		return;
 	}
-	request->send(200, "text/plain", values);
-	values = "";
+
+	AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [bundle](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+		while (bundle->step < 3) {
+			if (bundle->step == 1) {
+				if (bundle->uiFile) {
+					size_t len = bundle->uiFile.read(buffer, maxLen);
+					if (len) {
+						return len;
+					}
+					bundle->uiFile.close();
+				}
+				bundle->step++;
+				continue;
+			}
+			String &text = bundle->step ? bundle->suffix : bundle->prefix;
+			if (bundle->sent < text.length()) {
+				size_t len = std::min(maxLen, text.length() - bundle->sent);
+				memcpy(buffer, text.c_str() + bundle->sent, len);
+				bundle->sent += len;
+				return len;
+			}
+			bundle->sent = 0;
+			bundle->step++;
+		}
+		return 0;
+	});
+	response->addHeader("ETag", etag);
+	response->addHeader("Cache-Control", "no-cache");
+	metricsResponse(200, bundle->prefix.length() + uiSize + bundle->suffix.length());
+	request->send(response);
 }
 
 // Save user configuration data
@@ -1973,6 +4323,8 @@ void AsyncFFWebServer::post_rest_config(AsyncWebServerRequest *request) {
 
 	String target = PSTR("/");
 
+	// Apply all fields in memory, and write file only once
+	beginUserConfigTransaction();
 	for (uint8_t i = 0; i < request->args(); i++) {
 		DEBUG_VERBOSE_P("Arg %d: %s = %s", i, request->arg(i).c_str(), urldecode(request->arg(i)).c_str());
 		//check for post redirect
@@ -1982,208 +4334,205 @@ void AsyncFFWebServer::post_rest_config(AsyncWebServerRequest *request) {
 			save_user_config(request->argName(i), request->arg(i));
 		}
 	}
-
-	// Reload config
-	loadConfig();
-	loadUserConfig();
+	// Change callbacks are called for modified keys only
+	commitUserConfigTransaction();
+	metricsResponse(302);
 	request->redirect(target);
 }
 
 // Initialize server served URLs
 void AsyncFFWebServer::serverInit() {
 	//SERVER INIT
+	//routes registered by route() are checked first
+	routeHandler.server = this;
+	addHandler(&routeHandler);
+	//open and close login session
+	route("/login", HTTP_GET | HTTP_POST, FF_AUTH_NONE, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+		this->handleLogin(request);
+	});
+	route("/logout", HTTP_ANY, FF_AUTH_NONE, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+		this->handleLogout(request);
+	});
 	//list directory
-	on("/list", HTTP_GET, [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/list", HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->handleFileList(request);
 	});
-	//load editor
-	on("/edit", HTTP_GET, [this](AsyncWebServerRequest *request) {
+	//request metrics
+	on("/admin/metrics", HTTP_GET, metered("/admin/metrics", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
+		this->handleMetrics(request);
+	}, true));
+	//file system information
+	route("/fsinfo", HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+		this->handleFileSystemInfo(request);
+	});
+	//load editor
+	route("/edit", HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		if (!this->handleFileRead("/edit.html", request))
 			error404(request);
 	});
 	//create file
-	on("/edit", HTTP_PUT, [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/edit", HTTP_PUT, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->handleFileCreate(request);
 	});	//delete file
-	on("/edit", HTTP_DELETE, [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/edit", HTTP_DELETE, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->handleFileDelete(request);
 	});
 	//first callback is called after the request has ended with all parsed arguments
 	//second callback handles file uploads at that location
-	on("/edit", HTTP_POST, [](AsyncWebServerRequest *request) { request->send(200, "text/plain", ""); }, [this](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
+	on("/edit", HTTP_POST, metered("/edit", [this](AsyncWebServerRequest *request) {
+		// Request is admitted, replace files by uploaded ones (rejected requests keep temporary files until disconnection)
+		this->commitUploads(request);
+		// Upload errors are kept in request _tempObject
+		if (request->_tempObject) {
+			this->metricsResponse(500, strlen((const char *) request->_tempObject));
+			request->send(500, "text/plain", (const char *) request->_tempObject);
+			return;
+		}
+		this->sendResponse(request, 200, "text/plain", "");
+	}), [this](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
+		this->connectionActivity(request, FF_CONN_BODY);
 		this->handleFileUpload(request, filename, index, data, len, final);
 	});
-	on("/admin/generalvalues", HTTP_GET, [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/admin/generalvalues", HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_general_configuration_values_html(request);
 	});
-	on("/admin/values", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/admin/values", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_network_configuration_values_html(request);
 	});
-	on("/admin/connectionstate", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/admin/connectionstate", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_connection_state_values_html(request);
 	});
-	on("/admin/infovalues", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/admin/infovalues", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_information_values_html(request);
 	});
-	on("/admin/ntpvalues", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/admin/ntpvalues", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_NTP_configuration_values_html(request);
 	});
-	on("/config.html", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/config.html", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_network_configuration_html(request);
 	});
-	on("/scan", HTTP_GET, [](AsyncWebServerRequest *request) {
-		String json = PSTR("[");
-		int n = WiFi.scanComplete();
-		if (n == WIFI_SCAN_FAILED) {
-			WiFi.scanNetworks(true);
-		} else if (n) {
-			for (int i = 0; i < n; ++i) {
-				if (i) json += PSTR(",");
-				json += PSTR("{\"rssi\":") + String(WiFi.RSSI(i))
-					+ PSTR(",\"ssid\":\"") + WiFi.SSID(i) + PSTR("\"")
-					+ PSTR(",\"bssid\":\"") + WiFi.BSSIDstr(i) + PSTR("\"")
-					+ PSTR(",\"channel\":") + String(WiFi.channel(i))
-					+ PSTR(",\"secure\":") + String(WiFi.encryptionType(i));
-					+ PSTR(",\"hidden\":") + String(WiFi.isHidden(i) ? PSTR("true") : PSTR("false"))
-					+ PSTR("}");
-			}
-			WiFi.scanDelete();
-			if (WiFi.scanComplete() == WIFI_SCAN_FAILED) {
-				WiFi.scanNetworks(true);
-			}
-		}
-		json += PSTR("]");
-		request->send(200, "text/json", json);
-		json = "";
+	route("/scan", HTTP_GET, FF_AUTH_NONE, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+		this->send_wifi_scan_json(request);
 	});
-	on("/general.html", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/general.html", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_general_configuration_html(request);
 	});
-	on("/ntp.html", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/ntp.html", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_NTP_configuration_html(request);
 	});
-	on("/admin/restart", [this](AsyncWebServerRequest *request) {
+	on("/admin/restart", metered("/admin/restart", [this](AsyncWebServerRequest *request) {
 		DEBUG_VERBOSE(request->url().c_str());
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
 		this->restart_esp(request);
-	});
-	on("/admin/wwwauth", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	}, true));
+	route("/admin/wwwauth", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_wwwauth_configuration_values_html(request);
 	});
-	on("/admin", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/admin", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		if (!this->handleFileRead("/admin.html", request))
 			error404(request);
 	});
-	on("/system.html", [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/system.html", HTTP_ANY, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->send_wwwauth_configuration_html(request);
 	});
-	on("/update/updatepossible", [this](AsyncWebServerRequest *request) {
+	on("/update/updatepossible", metered("/update/updatepossible", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
 		this->send_update_firmware_values_html(request);
-	});
-	on("/setmd5", [this](AsyncWebServerRequest *request) {
+	}, true));
+	on("/setmd5", metered("/setmd5", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
 		//DEBUG_VERBOSE_P("md5?");
 		this->setUpdateMD5(request);
-	});
-	on("/update", HTTP_GET, [this](AsyncWebServerRequest *request) {
+	}, true));
+	on("/update", HTTP_GET, metered("/update", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
 		if (!this->handleFileRead("/update.html", request))
 			error404(request);
-	});
-	on("/update", HTTP_POST, [this](AsyncWebServerRequest *request) {
+	}, true));
+	on("/update", HTTP_POST, metered("/update", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
-		AsyncWebServerResponse *response = request->beginResponse(200, "text/html", (Update.hasError()) ? "FAIL" : "<META http-equiv=\"refresh\" content=\"15;URL=/update\">Update correct. Restarting...");
+			return this->requestAuth(request);
+		const char *message = Update.hasError() ? "FAIL" : "<META http-equiv=\"refresh\" content=\"15;URL=/update\">Update correct. Restarting...";
+		AsyncWebServerResponse *response = request->beginResponse(200, "text/html", message);
+		this->metricsResponse(200, strlen(message));
 		response->addHeader("Connection", "close");
 		response->addHeader("Access-Control-Allow-Origin", "*");
 		request->send(response);
 		this->_fs->end();
 		ESP.restart();
-	}, [this](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
+	}, true), [this](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
+		this->connectionActivity(request, FF_CONN_BODY);
 		this->updateFirmware(request, filename, index, data, len, final);
 	});
 
-	on("/rconfig", HTTP_GET, [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/rconfig.json", HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+		this->handle_rest_config_bundle(request);
+	});
+
+	route("/rconfig/*", HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->handle_rest_config(request);
 	});
 
-	on("/pconfig", HTTP_POST, [this](AsyncWebServerRequest *request) {
-		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+	route("/pconfig", HTTP_POST, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		this->post_rest_config(request);
 	});
 
-	on("/json", [this](AsyncWebServerRequest *request) {
+	on("/json", metered("/json", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
 		char tempBuffer[250];
 		tempBuffer[0] = 0;
 		if (this->traceFlag) trace_info_P("Request: %s", request->url().c_str());
+		if (this->sendCachedResponse(request)) {
+			return;
+		}
 		if (this->jsonCommandCallback) {
 			if (this->jsonCommandCallback(request)) {
 				return;
 			}
 		}
+		// Send bound values if not done by user
+		if (request->url() == "/json/values" && this->sendBoundValuesJson(request)) {
+			return;
+		}
 		if (this->debugFlag) trace_debug_P("Unknown JSON request: %s", request->url().c_str());
 		snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("Can't understand: %s\n"), request->url().c_str());
+		this->metricsResponse(400, strlen(tempBuffer));
 		request->send(400, "text/plain", tempBuffer);
-	});
+	}));
 
-	on("/rest", [this](AsyncWebServerRequest *request) {
+	on("/rest", metered("/rest", [this](AsyncWebServerRequest *request) {
 		char tempBuffer[250];
 		tempBuffer[0] = 0;
 
 		if (this->traceFlag) trace_info_P("Request: %s", request->url().c_str());
+		if (this->sendCachedResponse(request)) {
+			return;
+		}
 		if (this->restCommandCallback) {
 			if (this->restCommandCallback(request)) {
 				return;
 			}
 		}
+		// Send bound values if not done by user
+		if (request->url() == "/rest/values" && this->sendBoundValuesRest(request)) {
+			return;
+		}
 		if (this->debugFlag) trace_debug_P("Unknown REST request: %s", request->url().c_str());
 		snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("Can't understand: %s\n"), request->url().c_str());
+		this->metricsResponse(400, strlen(tempBuffer));
 		request->send(400, "text/plain", tempBuffer);
-	});
+	}));
 
-	on("/post", [this](AsyncWebServerRequest *request) {
+	on("/post", metered("/post", [this](AsyncWebServerRequest *request) {
 		if (!this->checkAuth(request))
-			return request->requestAuthentication();
+			return this->requestAuth(request);
 		char tempBuffer[250];
 		tempBuffer[0] = 0;
 
@@ -2195,35 +4544,60 @@ void AsyncFFWebServer::serverInit() {
 		}
 		if (this->debugFlag) trace_debug_P("Unknown POST request: %s", request->url().c_str());
 		snprintf_P(tempBuffer, sizeof(tempBuffer), PSTR("Can't understand: %s\n"), request->url().c_str());
+		this->metricsResponse(400, strlen(tempBuffer));
 		request->send(400, "text/plain", tempBuffer);
-	});
+	}));
 
 	//called when the url is not defined here
 	//use it to load content from LitleFS
-	onNotFound([this](AsyncWebServerRequest *request) {
+	ArRequestHandlerFunction notFound = metered("notFound", [this](AsyncWebServerRequest *request) {
 	if (!this->checkAuth(request)) {
 		DEBUG_VERBOSE_P("Request authentication");
-		return request->requestAuthentication();
+		return this->requestAuth(request);
 	}
-	AsyncWebServerResponse *response = request->beginResponse(200);
-	response->addHeader("Connection", "close");
-	response->addHeader("Access-Control-Allow-Origin", "*");
 	if (!this->handleFileRead(request->url(), request)) {
 		DEBUG_ERROR_P("Not found: %s", request->url().c_str());
 		error404(request);
 	}
-	delete response; // Free up memory!
+	});
+	// Event source connections (and their buffers) are admitted as other requests: refused by event source filter,
+	//	they reach not found handler, which answers them with a 503 (filter is checked before URL by ESPAsyncWebServer)
+	_evs.setFilter([this](AsyncWebServerRequest *request) {
+		if (request->method() != HTTP_GET || request->url() != "/events") {
+			return true;
+		}
+		this->eventsRejection = this->admissionCounter();
+		this->eventsRejected = this->eventsRejection ? request : NULL;
+		return this->eventsRejection == NULL;
+	});
+	ArRequestHandlerFunction eventsBusy = metered("/events", [this](AsyncWebServerRequest *request) {
+		this->rejectRequest(request, this->eventsRejection);
+	}, true);
+	onNotFound([this, notFound, eventsBusy](AsyncWebServerRequest *request) {
+		if (request == this->eventsRejected && request->url() == "/events") {
+			this->eventsRejected = NULL;
+			return eventsBusy(request);
+		}
+		notFound(request);
 	});
 
-	_evs.onConnect([](AsyncEventSourceClient* client) {
+	_evs.onConnect([this](AsyncEventSourceClient* client) {
 		DEBUG_VERBOSE_P("Event source client connected from %s", client->client()->remoteIP().toString().c_str());
+		// Event source keeps connection after request is deleted, stop supervising it
+		this->releaseConnection(client->client());
+		// Tell client if values are pushed, and send all of them
+		if (this->pushValues.empty()) {
+			client->send("off", "push", millis());
+		} else {
+			client->send("on", "push", millis());
+			client->send(this->formatPushValues(true).c_str(), "values", millis());
+		}
 	});
 	addHandler(&_evs);
 
 	#ifdef HIDE_SECRET
-		on(SECRET_FILE, HTTP_GET, [this](AsyncWebServerRequest *request) {
-			if (!this->checkAuth(request))
-				return request->requestAuthentication();
+		route(SECRET_FILE, HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+			this->metricsResponse(403, 9);
 			AsyncWebServerResponse *response = request->beginResponse(403, "text/plain", "Forbidden");
 			response->addHeader("Connection", "close");
 			response->addHeader("Access-Control-Allow-Origin", "*");
@@ -2232,18 +4606,16 @@ void AsyncFFWebServer::serverInit() {
 	#endif // HIDE_SECRET
 
 	#ifdef HIDE_CONFIG
-		on(CONFIG_FILE, HTTP_GET, [this](AsyncWebServerRequest *request) {
-			if (!this->checkAuth(request))
-				return request->requestAuthentication();
+		route(CONFIG_FILE, HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+			this->metricsResponse(403, 9);
 			AsyncWebServerResponse *response = request->beginResponse(403, "text/plain", "Forbidden");
 			response->addHeader("Connection", "close");
 			response->addHeader("Access-Control-Allow-Origin", "*");
 			request->send(response);
 		});
 
-		on(USER_CONFIG_FILE, HTTP_GET, [this](AsyncWebServerRequest *request) {
-			if (!this->checkAuth(request))
-				return request->requestAuthentication();
+		route(USER_CONFIG_FILE, HTTP_GET, FF_AUTH_REQUIRED, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
+			this->metricsResponse(403, 9);
 			AsyncWebServerResponse *response = request->beginResponse(403, "text/plain", "Forbidden");
 			response->addHeader("Connection", "close");
 			response->addHeader("Access-Control-Allow-Origin", "*");
@@ -2253,24 +4625,728 @@ void AsyncFFWebServer::serverInit() {
 	#endif // HIDE_CONFIG
 
 	//get heap status, analog input value and all GPIO statuses in one json call
-	on("/all", HTTP_GET, [](AsyncWebServerRequest *request) {
+	route("/all", HTTP_GET, FF_AUTH_NONE, [this](AsyncWebServerRequest *request, FF_RouteParams &params) {
 		String json = PSTR("{\"heap\":") + String(ESP.getFreeHeap())
 			+ PSTR(", \"analog\":") + String(analogRead(A0))
 			+ PSTR(", \"gpio\":") + String((uint32_t)(((GPI | GPO) & 0xFFFF) | ((GP16I & 0x01) << 16)))
 			+ PSTR("}");
-		request->send(200, "text/json", json);
+		this->sendResponse(request, 200, "text/json", json);
 		json = String();
 	});
 	DEBUG_VERBOSE_P("HTTP server started");
 }
 
+// Upper limits of handler time histogram buckets (us), last one is unlimited
+static const uint32_t metricsBucketLimits[FF_METRICS_BUCKETS - 1] = {100, 500, 1000, 5000, 20000, 100000};
+// Forced connection close reason names (in ffCloseReason_t order)
+static const char *connectionCloseNames[FF_CLOSE_REASONS] = {"header", "body", "write", "evicted", "refused"};
+// Status classes names
+static const char *metricsClassNames[FF_METRICS_CLASSES] = {"2xx", "3xx", "4xx", "5xx", "other"};
+
+/*
+
+	Return a request handler recording metrics of given one
+
+	Request count, status class, known bytes sent, handler time and free heap delta are kept per route.
+	Status and length are known only when answer is sent by FF_WebServer (through metricsResponse()),
+		as ESPAsyncWebServer doesn't give access to response sent by handler. Others are counted as "other".
+	Non critical requests are rejected with a 503 answer when memory is low or too many requests are in progress,
+		and with a 429 answer when client exceeds rate limit of request URL.
+
+*/
+ArRequestHandlerFunction AsyncFFWebServer::metered(const char *route, ArRequestHandlerFunction handler, const bool critical) {
+	size_t index;
+	// Same route with different methods share the same metrics
+	for (index = 0; index < routeMetrics.size(); index++) {
+		if (!strcmp(routeMetrics[index].route, route)) {
+			break;
+		}
+	}
+	if (index == routeMetrics.size()) {
+		ffRouteMetrics_t metrics;
+		memset(&metrics, 0, sizeof(metrics));
+		metrics.route = route;
+		routeMetrics.push_back(metrics);
+	}
+	return [this, index, handler, critical](AsyncWebServerRequest *request) {
+		uint32_t freeHeap = ESP.getFreeHeap();
+		this->metricsCode = 0;
+		this->metricsBytes = 0;
+		unsigned long startTime = micros();
+		if (critical || (this->admitRequest(request) && this->rateLimitRequest(request))) {
+			// Request is in progress until its answer is sent (or connection lost)
+			ffConnection_t *connection = this->findConnection(request->client());
+			if (connection) {
+				connection->inFlight = true;
+				connection->state = FF_CONN_SENDING;
+				connection->lastActivity = millis();
+			}
+			handler(request);
+		}
+		this->recordRouteMetrics(index, micros() - startTime, (int32_t) ESP.getFreeHeap() - (int32_t) freeHeap);
+	};
+}
+
+// Check free heap, largest free block and requests in progress, sending a 503 answer if request can't be admitted
+bool AsyncFFWebServer::admitRequest(AsyncWebServerRequest *request) {
+	uint32_t *counter = admissionCounter();
+	if (!counter) {
+		return true;
+	}
+	rejectRequest(request, counter);
+	return false;
+}
+
+// Return rejection counter of first failed admission check (NULL if request can be admitted)
+uint32_t *AsyncFFWebServer::admissionCounter(void) {
+	if (requestsInFlight() >= admissionMaxInFlight) {
+		return &rejectedInFlight;
+	}
+	if (ESP.getFreeHeap() < admissionMinHeap) {
+		return &rejectedHeap;
+	}
+	if (ESP.getMaxFreeBlockSize() < admissionMinBlock) {
+		return &rejectedBlock;
+	}
+	return NULL;
+}
+
+// Count a rejected request and send its 503 answer
+void AsyncFFWebServer::rejectRequest(AsyncWebServerRequest *request, uint32_t *counter) {
+	(*counter)++;
+	if (debugFlag) trace_debug_P("Rejected %s: heap=%u, block=%u, inFlight=%u", request->url().c_str(), ESP.getFreeHeap(), ESP.getMaxFreeBlockSize(), requestsInFlight());
+	AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Busy");
+	response->addHeader("Retry-After", String(FF_ADMISSION_RETRY_AFTER));
+	response->addHeader("Connection", "close");
+	metricsResponse(503, 4);
+	request->send(response);
+}
+
+/*
+
+	Connection supervisor
+
+	AsyncWebServer client handler is replaced by acceptConnection(), which tracks each accepted client
+		before creating its request, as ESPAsyncWebServer would do.
+	serviceConnections() closes (and counts per reason) connections that don't receive headers in time,
+		stop sending request body, or don't acknowledge answer data.
+	When a new client arrives and table is full, the idle connection (waiting for headers, or with nothing to send)
+		without progress for the longest time is closed. New client is closed if no connection is idle.
+	Connections leave table when request is disconnected (through request onDisconnect() callback, handlers should
+		use onRequestDisconnect() instead of redefining it), or when taken over by a web socket or an event source
+		(detected on Upgrade or Accept: text/event-stream headers, as these handlers delete request without disconnection).
+
+*/
+void AsyncFFWebServer::acceptConnection(AsyncClient *client) {
+	if (!client) {
+		return;
+	}
+	unsigned long now = millis();
+	ffConnection_t *connection = findConnection(NULL);
+	if (!connection) {
+		// Table is full, close oldest idle connection
+		ffConnection_t *oldest = NULL;
+		for (uint8_t i = 0; i < FF_CONN_MAX; i++) {
+			if (isIdleConnection(&connections[i]) && (!oldest || (now - connections[i].lastActivity) > (now - oldest->lastActivity))) {
+				oldest = &connections[i];
+			}
+		}
+		if (!oldest) {
+			// All connections are working, refuse new one
+			connectionCloses[FF_CLOSE_REFUSED]++;
+			if (debugFlag) trace_debug_P("Refusing connection from %s", client->remoteIP().toString().c_str());
+			client->close(true);
+			client->free();
+			delete client;
+			return;
+		}
+		closeConnection(oldest, FF_CLOSE_EVICTED);
+		connection = oldest;
+	}
+	// Library timeouts are kept as a backstop, supervisor should close connections first
+	client->setRxTimeout(((max(connHeaderTimeout, connBodyTimeout) + 999) / 1000) + 2);
+	client->setAckTimeout(connWriteTimeout + 2000);
+	connection->client = client;
+	connection->acceptTime = now;
+	connection->lastActivity = now;
+	connection->fullSpace = client->space();
+	connection->space = connection->fullSpace;
+	connection->state = FF_CONN_HEADERS;
+	connection->inFlight = false;
+	connectionDisconnects[connection - connections] = nullptr;
+	AsyncWebServerRequest *request = new AsyncWebServerRequest(this, client);
+	if (!request) {
+		connection->client = NULL;
+		client->close(true);
+		client->free();
+		delete client;
+		return;
+	}
+	request->onDisconnect([this, client]() {
+		this->requestDisconnected(client);
+	});
+}
+
+// Check if a connection may be evicted: still waiting for headers, or answer fully sent and no handler in progress
+bool AsyncFFWebServer::isIdleConnection(ffConnection_t *connection) {
+	if (!connection->client) {
+		return false;
+	}
+	if (connection->state == FF_CONN_HEADERS) {
+		return true;
+	}
+	return connection->state == FF_CONN_SENDING && !connection->inFlight && connection->client->space() >= connection->fullSpace;
+}
+
+// Release connection of a disconnected request, then call user's disconnect callback
+void AsyncFFWebServer::requestDisconnected(AsyncClient *client) {
+	ArDisconnectHandler handler;
+	ffConnection_t *connection = findConnection(client);
+	if (connection) {
+		handler = connectionDisconnects[connection - connections];
+	}
+	releaseConnection(client);
+	if (handler) {
+		handler();
+	}
+}
+
+/*!
+
+	Set a routine called when request is disconnected
+
+	Request onDisconnect() callback is used by connection supervisor, so handlers should use this routine instead.
+		Callback is called after request has been removed from supervised connections.
+
+	\param[in]	request: request to watch
+	\param[in]	handler: routine to call when request is disconnected
+	\return	None
+
+*/
+void AsyncFFWebServer::onRequestDisconnect(AsyncWebServerRequest *request, ArDisconnectHandler handler) {
+	ffConnection_t *connection = findConnection(request->client());
+	if (connection) {
+		connectionDisconnects[connection - connections] = handler;
+	} else {
+		// Request is not supervised, its callback is free
+		request->onDisconnect(handler);
+	}
+}
+
+// Return supervised connection of a client (or first free entry if client is NULL)
+ffConnection_t *AsyncFFWebServer::findConnection(AsyncClient *client) {
+	for (uint8_t i = 0; i < FF_CONN_MAX; i++) {
+		if (connections[i].client == client) {
+			return &connections[i];
+		}
+	}
+	return NULL;
+}
+
+// Remove a client from supervised connections (client may already be deleted, pointer is only compared)
+void AsyncFFWebServer::releaseConnection(AsyncClient *client) {
+	ffConnection_t *connection = client ? findConnection(client) : NULL;
+	if (!connection) {
+		return;
+	}
+	// Drop unfinished uploads of this client
+	for (uint8_t i = 0; i < FF_UPLOAD_CONTEXTS; i++) {
+		if (uploads[i].request && uploads[i].client == client) {
+			abortUpload(&uploads[i]);
+		}
+	}
+	connection->client = NULL;
+	connection->inFlight = false;
+	connectionDisconnects[connection - connections] = nullptr;
+}
+
+// Force a supervised connection close, counting it
+void AsyncFFWebServer::closeConnection(ffConnection_t *connection, const ffCloseReason_t reason) {
+	AsyncClient *client = connection->client;
+	if (!client) {
+		return;
+	}
+	connectionCloses[reason]++;
+	if (debugFlag) trace_debug_P("Closing connection from %s, reason %d, state %d, age %lu ms", client->remoteIP().toString().c_str(), reason, connection->state, millis() - connection->acceptTime);
+	// Closing calls request onDisconnect() callback, which releases connection
+	client->close(true);
+	releaseConnection(client);
+}
+
+// Signal progress of a request (headers received, body data received or answer started)
+void AsyncFFWebServer::connectionActivity(AsyncWebServerRequest *request, const ffConnectionState_t state) {
+	ffConnection_t *connection = findConnection(request->client());
+	if (connection) {
+		if (state > connection->state) {
+			connection->state = state;
+		}
+		connection->lastActivity = millis();
+	}
+}
+
+// Dump supervised connections and forced closes on trace
+void AsyncFFWebServer::dumpConnections(void) {
+	trace_info_P("Connections: open=%u, closed header=%u, body=%u, write=%u, evicted=%u, refused=%u", openConnections(),
+		connectionCloses[FF_CLOSE_HEADER], connectionCloses[FF_CLOSE_BODY], connectionCloses[FF_CLOSE_WRITE], connectionCloses[FF_CLOSE_EVICTED],
+		connectionCloses[FF_CLOSE_REFUSED]);
+}
+
+// Return number of requests in progress (handler called, connection still open)
+uint8_t AsyncFFWebServer::requestsInFlight(void) {
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < FF_CONN_MAX; i++) {
+		if (connections[i].client && connections[i].inFlight) {
+			count++;
+		}
+	}
+	return count;
+}
+
+// Return number of supervised connections
+uint8_t AsyncFFWebServer::openConnections(void) {
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < FF_CONN_MAX; i++) {
+		if (connections[i].client) {
+			count++;
+		}
+	}
+	return count;
+}
+
+// Check supervised connections deadlines
+void AsyncFFWebServer::serviceConnections(void) {
+	unsigned long now = millis();
+	for (uint8_t i = 0; i < FF_CONN_MAX; i++) {
+		ffConnection_t *connection = &connections[i];
+		// Disconnected clients are released by their request disconnect callback
+		if (!connection->client || !connection->client->connected()) {
+			continue;
+		}
+		// Answer started by a handler not signaling it: data is waiting in send buffer
+		size_t space = connection->client->space();
+		if (connection->state != FF_CONN_SENDING && space != connection->fullSpace) {
+			connection->state = FF_CONN_SENDING;
+			connection->lastActivity = now;
+		}
+		if (connection->state == FF_CONN_HEADERS) {
+			if ((now - connection->acceptTime) >= connHeaderTimeout) {
+				closeConnection(connection, FF_CLOSE_HEADER);
+			}
+		} else if (connection->state == FF_CONN_BODY) {
+			if ((now - connection->lastActivity) >= connBodyTimeout) {
+				closeConnection(connection, FF_CLOSE_BODY);
+			}
+		} else if (space != connection->space) {
+			// Client acknowledged data (or handler sent more)
+			connection->space = space;
+			connection->lastActivity = now;
+		} else if (space < connection->fullSpace && (now - connection->lastActivity) >= connWriteTimeout) {
+			closeConnection(connection, FF_CLOSE_WRITE);
+		}
+	}
+}
+
+/*
+
+	Load rate limit rules from RateLimits key
+
+	Format is a comma separated list of <URL prefix>:<requests per minute>:<burst>,
+		for example "/rest:60:10,/json:60:10,/all:30:5,/scan:6:2".
+
+*/
+void AsyncFFWebServer::parseRateLimits(const char *limits) {
+	rateRuleCount = 0;
+	memset(rateBuckets, 0, sizeof(rateBuckets));
+	const char *rule = limits;
+	while (rule && *rule) {
+		const char *next = strchr(rule, ',');
+		size_t length = next ? (size_t) (next - rule) : strlen(rule);
+		char buffer[40];
+		if (length < sizeof(buffer)) {
+			memcpy(buffer, rule, length);
+			buffer[length] = 0;
+			char *perMinute = strchr(buffer, ':');
+			char *burst = perMinute ? strchr(perMinute + 1, ':') : NULL;
+			if (burst && rateRuleCount < FF_RATE_LIMIT_RULES) {
+				*perMinute++ = 0;
+				*burst++ = 0;
+				ffRateRule_t *item = &rateRules[rateRuleCount];
+				strncpy(item->prefix, buffer, sizeof(item->prefix));
+				item->prefix[sizeof(item->prefix) - 1] = 0;
+				// Check values against field sizes, instead of silently truncating them
+				long perMinuteValue = atol(perMinute);
+				long burstValue = atol(burst);
+				item->perMinute = perMinuteValue;
+				item->burst = burstValue;
+				if (item->prefix[0] == '/' && perMinuteValue > 0 && perMinuteValue <= UINT16_MAX && burstValue > 0 && burstValue <= UINT8_MAX) {
+					rateRuleCount++;
+				} else {
+					DEBUG_ERROR_P("Invalid rate limit %s:%s:%s", buffer, perMinute, burst);
+				}
+			} else {
+				DEBUG_ERROR_P("Rate limit %s ignored", buffer);
+			}
+		} else {
+			DEBUG_ERROR_P("Rate limit rule too long, ignored");
+		}
+		rule = next ? next + 1 : NULL;
+	}
+}
+
+// Take a token from client's bucket for request URL, sending a 429 answer if bucket is empty
+bool AsyncFFWebServer::rateLimitRequest(AsyncWebServerRequest *request) {
+	uint8_t rule;
+	for (rule = 0; rule < rateRuleCount; rule++) {
+		if (request->url().startsWith(rateRules[rule].prefix)) {
+			break;
+		}
+	}
+	if (rule >= rateRuleCount) {
+		return true;
+	}
+	uint32_t ip = request->client()->remoteIP();
+	unsigned long now = millis();
+	// Find client bucket, else reuse least recently used one
+	ffRateBucket_t *bucket = &rateBuckets[0];
+	for (uint8_t i = 0; i < FF_RATE_LIMIT_CLIENTS; i++) {
+		if (rateBuckets[i].ip == ip && rateBuckets[i].rule == rule) {
+			bucket = &rateBuckets[i];
+			break;
+		}
+		if (!rateBuckets[i].ip || (bucket->ip && (now - rateBuckets[i].lastRefill) > (now - bucket->lastRefill))) {
+			bucket = &rateBuckets[i];
+		}
+	}
+	const ffRateRule_t *limit = &rateRules[rule];
+	if (bucket->ip != ip || bucket->rule != rule) {
+		bucket->ip = ip;
+		bucket->rule = rule;
+		bucket->tokens = limit->burst * 1000UL;
+		bucket->lastRefill = now;
+	} else {
+		// A token (1000) is added every 60000 / perMinute ms
+		uint64_t added = (uint64_t) (now - bucket->lastRefill) * limit->perMinute / 60;
+		uint64_t tokens = bucket->tokens + added;
+		if (tokens >= limit->burst * 1000UL) {
+			bucket->tokens = limit->burst * 1000UL;
+			bucket->lastRefill = now;
+		} else {
+			// Only advance refill time by time converted into tokens, to keep remainder for next request
+			bucket->tokens = (uint32_t) tokens;
+			bucket->lastRefill += (unsigned long) (added * 60 / limit->perMinute);
+		}
+	}
+	if (bucket->tokens >= 1000) {
+		bucket->tokens -= 1000;
+		return true;
+	}
+	rateLimited++;
+	if (debugFlag) trace_debug_P("Rate limited %s from %s", request->url().c_str(), request->client()->remoteIP().toString().c_str());
+	char retryAfter[12];
+	snprintf_P(retryAfter, sizeof(retryAfter), PSTR("%lu"), (unsigned long) ((1000 - bucket->tokens) * 60 / limit->perMinute + 999) / 1000);
+	AsyncWebServerResponse *response = request->beginResponse(429, "text/plain", "Too many requests");
+	response->addHeader("Retry-After", retryAfter);
+	response->addHeader("Connection", "close");
+	metricsResponse(429, 17);
+	request->send(response);
+	return false;
+}
+
+/*!
+
+	Give status and length of answer of request being handled, for request metrics
+
+	Answers sent by FF_WebServer (files, errors, FF_ValuesResponse, sendResponse()...) are already counted.
+		Handlers sending answers by other means (i.e. request->send()) may call this routine to have them
+		counted in right status class, instead of "other".
+
+	\param[in]	code: HTTP status code
+	\param[in]	length: length of answer body (bytes)
+	\return	None
+
+*/
+void AsyncFFWebServer::metricsResponse(const int code, const size_t length) {
+	metricsCode = code;
+	metricsBytes = length;
+}
+
+// Ask for authentication, counting a 401 answer
+void AsyncFFWebServer::requestAuth(AsyncWebServerRequest *request) {
+	metricsResponse(401);
+	request->requestAuthentication();
+}
+
+// Add a request to metrics of a route
+void AsyncFFWebServer::recordRouteMetrics(const size_t index, const uint32_t duration, const int32_t heapDelta) {
+	ffRouteMetrics_t *metrics = &routeMetrics[index];
+	metrics->count++;
+	uint8_t statusClass = (metricsCode >= 200 && metricsCode < 600) ? (metricsCode / 100) - 2 : FF_METRICS_CLASSES - 1;
+	metrics->classes[statusClass]++;
+	metrics->bytes += metricsBytes;
+	uint8_t bucket = 0;
+	while (bucket < FF_METRICS_BUCKETS - 1 && duration > metricsBucketLimits[bucket]) {
+		bucket++;
+	}
+	metrics->buckets[bucket]++;
+	metrics->totalTime += duration;
+	if (duration > metrics->maxTime) {
+		metrics->maxTime = duration;
+	}
+	if (heapDelta < metrics->minHeapDelta) {
+		metrics->minHeapDelta = heapDelta;
+	}
+}
+
+// Send request metrics in Prometheus text format
+void AsyncFFWebServer::handleMetrics(AsyncWebServerRequest *request) {
+	AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+	// Count written bytes for metrics
+	FF_TeePrint out;
+	out.output = response;
+	out.print(F("# TYPE ff_http_requests_total counter\n"));
+	for (const ffRouteMetrics_t &metrics : routeMetrics) {
+		for (uint8_t i = 0; i < FF_METRICS_CLASSES; i++) {
+			if (metrics.classes[i]) {
+				out.printf_P(PSTR("ff_http_requests_total{route=\"%s\",class=\"%s\"} %u\n"), metrics.route, metricsClassNames[i], metrics.classes[i]);
+			}
+		}
+	}
+	out.print(F("# TYPE ff_http_response_bytes_total counter\n"));
+	for (const ffRouteMetrics_t &metrics : routeMetrics) {
+		out.printf_P(PSTR("ff_http_response_bytes_total{route=\"%s\"} %u\n"), metrics.route, metrics.bytes);
+	}
+	out.print(F("# TYPE ff_http_handler_microseconds histogram\n"));
+	for (const ffRouteMetrics_t &metrics : routeMetrics) {
+		if (!metrics.count) {
+			continue;
+		}
+		uint32_t cumulated = 0;
+		for (uint8_t i = 0; i < FF_METRICS_BUCKETS - 1; i++) {
+			cumulated += metrics.buckets[i];
+			out.printf_P(PSTR("ff_http_handler_microseconds_bucket{route=\"%s\",le=\"%u\"} %u\n"), metrics.route, metricsBucketLimits[i], cumulated);
+		}
+		out.printf_P(PSTR("ff_http_handler_microseconds_bucket{route=\"%s\",le=\"+Inf\"} %u\n"), metrics.route, metrics.count);
+		out.printf_P(PSTR("ff_http_handler_microseconds_sum{route=\"%s\"} %llu\n"), metrics.route, metrics.totalTime);
+		out.printf_P(PSTR("ff_http_handler_microseconds_count{route=\"%s\"} %u\n"), metrics.route, metrics.count);
+	}
+	out.print(F("# TYPE ff_http_handler_max_microseconds gauge\n"));
+	for (const ffRouteMetrics_t &metrics : routeMetrics) {
+		if (metrics.count) {
+			out.printf_P(PSTR("ff_http_handler_max_microseconds{route=\"%s\"} %u\n"), metrics.route, metrics.maxTime);
+		}
+	}
+	out.print(F("# TYPE ff_http_handler_heap_delta_min_bytes gauge\n"));
+	for (const ffRouteMetrics_t &metrics : routeMetrics) {
+		if (metrics.count) {
+			out.printf_P(PSTR("ff_http_handler_heap_delta_min_bytes{route=\"%s\"} %d\n"), metrics.route, metrics.minHeapDelta);
+		}
+	}
+	out.print(F("# TYPE ff_http_rejected_total counter\n"));
+	out.printf_P(PSTR("ff_http_rejected_total{reason=\"heap\"} %u\n"), rejectedHeap);
+	out.printf_P(PSTR("ff_http_rejected_total{reason=\"block\"} %u\n"), rejectedBlock);
+	out.printf_P(PSTR("ff_http_rejected_total{reason=\"inflight\"} %u\n"), rejectedInFlight);
+	out.printf_P(PSTR("ff_http_rejected_total{reason=\"ratelimit\"} %u\n"), rateLimited);
+	out.print(F("# TYPE ff_http_in_flight gauge\n"));
+	out.printf_P(PSTR("ff_http_in_flight %u\n"), requestsInFlight());
+	out.print(F("# TYPE ff_http_connection_closed_total counter\n"));
+	for (uint8_t i = 0; i < FF_CLOSE_REASONS; i++) {
+		out.printf_P(PSTR("ff_http_connection_closed_total{reason=\"%s\"} %u\n"), connectionCloseNames[i], connectionCloses[i]);
+	}
+	out.print(F("# TYPE ff_http_connections gauge\n"));
+	out.printf_P(PSTR("ff_http_connections %u\n"), openConnections());
+	out.print(F("# TYPE ff_max_free_block_bytes gauge\n"));
+	out.printf_P(PSTR("ff_max_free_block_bytes %u\n"), ESP.getMaxFreeBlockSize());
+	out.print(F("# TYPE ff_http_response_cache_total counter\n"));
+	out.printf_P(PSTR("ff_http_response_cache_total{result=\"hit\"} %u\n"), responseCacheHits);
+	out.printf_P(PSTR("ff_http_response_cache_total{result=\"miss\"} %u\n"), responseCacheMisses);
+	out.print(F("# TYPE ff_free_heap_bytes gauge\n"));
+	out.printf_P(PSTR("ff_free_heap_bytes %u\n"), ESP.getFreeHeap());
+	out.print(F("# TYPE ff_uptime_seconds counter\n"));
+	out.printf_P(PSTR("ff_uptime_seconds %lu\n"), millis() / 1000);
+	metricsResponse(200, out.count);
+	request->send(response);
+}
+
+// Dump request metrics on trace (metrics debug command)
+void AsyncFFWebServer::dumpMetrics(void) {
+	trace_info_P("Response cache: hits=%u, misses=%u", responseCacheHits, responseCacheMisses);
+	trace_info_P("Rejected: heap=%u, block=%u, inFlight=%u, rateLimit=%u, now in flight=%u", rejectedHeap, rejectedBlock, rejectedInFlight, rateLimited, requestsInFlight());
+	dumpConnections();
+	for (const ffRouteMetrics_t &metrics : routeMetrics) {
+		if (!metrics.count) {
+			continue;
+		}
+		trace_info_P("%s: count=%u, 2xx=%u, 3xx=%u, 4xx=%u, 5xx=%u, other=%u, bytes=%u, avg=%uus, max=%uus, heap=%d",
+			metrics.route, metrics.count, metrics.classes[0], metrics.classes[1], metrics.classes[2], metrics.classes[3], metrics.classes[4],
+			metrics.bytes, (uint32_t) (metrics.totalTime / metrics.count), metrics.maxTime, metrics.minHeapDelta);
+	}
+}
+
 // Check for authentication need
 bool AsyncFFWebServer::checkAuth(AsyncWebServerRequest *request) {
 	if (!_httpAuth.auth) {
 		return true;
 	} else {
-		return request->authenticate(_httpAuth.wwwUsername.c_str(), _httpAuth.wwwPassword.c_str());
+		// Session cookie given by /login is checked first, then Basic authentication
+		return findSession(request) || request->authenticate(_httpAuth.wwwUsername.c_str(), _httpAuth.wwwPassword.c_str());
+	}
+}
+
+// ----- Login sessions -----
+
+// Compute HMAC-SHA256 of a session id and creation time
+void AsyncFFWebServer::computeSessionMac(const uint8_t *id, const uint32_t created, uint8_t *mac) {
+	if (!sessionKeyLoaded) {
+		ESP.random(sessionKey, sizeof(sessionKey));
+		sessionKeyLoaded = true;
+	}
+	br_hmac_key_context keyContext;
+	br_hmac_context context;
+	br_hmac_key_init(&keyContext, &br_sha256_vtable, sessionKey, sizeof(sessionKey));
+	br_hmac_init(&context, &keyContext, 0);
+	br_hmac_update(&context, id, FF_SESSION_ID_SIZE);
+	br_hmac_update(&context, &created, sizeof(created));
+	br_hmac_out(&context, mac);
+}
+
+/*
+
+	Return session of request cookie, NULL if none or invalid
+
+	Cookie contains session id, creation time and their HMAC, in hexadecimal.
+		HMAC is compared in constant time, and session should still be in table (not logged out or replaced).
+		Session age is computed as elapsed time since creation, so it stays valid when millis() wraps.
+
+*/
+ffSession_t *AsyncFFWebServer::findSession(AsyncWebServerRequest *request) {
+	if (!request->hasHeader("Cookie")) {
+		return NULL;
+	}
+	const String &cookies = request->header("Cookie");
+	int start = cookies.indexOf(FF_SESSION_COOKIE "=");
+	if (start < 0) {
+		return NULL;
+	}
+	const char *value = cookies.c_str() + start + sizeof(FF_SESSION_COOKIE);
+	// Decode id, creation time and mac
+	uint8_t buffer[FF_SESSION_ID_SIZE + sizeof(uint32_t) + FF_SESSION_MAC_SIZE];
+	for (size_t i = 0; i < sizeof(buffer); i++) {
+		char high = value[2 * i];
+		char low = high ? value[(2 * i) + 1] : 0;
+		if (!isHexadecimalDigit(high) || !isHexadecimalDigit(low)) {
+			return NULL;
+		}
+		buffer[i] = (((high <= '9') ? high - '0' : (high | 0x20) - 'a' + 10) << 4)
+			| ((low <= '9') ? low - '0' : (low | 0x20) - 'a' + 10);
+	}
+	uint32_t created;
+	memcpy(&created, buffer + FF_SESSION_ID_SIZE, sizeof(created));
+	if ((uint32_t) millis() - created >= FF_SESSION_DURATION * 1000UL) {
+		return NULL;
+	}
+	ffSession_t *session = NULL;
+	for (uint8_t i = 0; i < FF_SESSION_COUNT; i++) {
+		if (sessions[i].active && sessions[i].created == created && !memcmp(sessions[i].id, buffer, FF_SESSION_ID_SIZE)) {
+			session = &sessions[i];
+			break;
+		}
+	}
+	if (!session) {
+		return NULL;
+	}
+	uint8_t mac[FF_SESSION_MAC_SIZE];
+	computeSessionMac(session->id, session->created, mac);
+	uint8_t difference = 0;
+	for (size_t i = 0; i < FF_SESSION_MAC_SIZE; i++) {
+		difference |= mac[i] ^ buffer[FF_SESSION_ID_SIZE + sizeof(uint32_t) + i];
+	}
+	return difference ? NULL : session;
+}
+
+// Open a new session, replacing the oldest one if table is full. Returns cookie value
+String AsyncFFWebServer::createSession(void) {
+	uint32_t now = millis();
+	ffSession_t *session = &sessions[0];
+	for (uint8_t i = 0; i < FF_SESSION_COUNT && session->active; i++) {
+		if (!sessions[i].active || now - sessions[i].created > now - session->created) {
+			session = &sessions[i];
+		}
+	}
+	ESP.random(session->id, FF_SESSION_ID_SIZE);
+	session->created = now;
+	session->active = true;
+	uint8_t buffer[FF_SESSION_ID_SIZE + sizeof(uint32_t) + FF_SESSION_MAC_SIZE];
+	memcpy(buffer, session->id, FF_SESSION_ID_SIZE);
+	memcpy(buffer + FF_SESSION_ID_SIZE, &session->created, sizeof(uint32_t));
+	computeSessionMac(session->id, session->created, buffer + FF_SESSION_ID_SIZE + sizeof(uint32_t));
+	char cookie[(2 * sizeof(buffer)) + 1];
+	for (size_t i = 0; i < sizeof(buffer); i++) {
+		snprintf_P(&cookie[2 * i], 3, PSTR("%02x"), buffer[i]);
+	}
+	return String(cookie);
+}
+
+// Close all sessions (called when authentication settings change)
+void AsyncFFWebServer::clearSessions(void) {
+	memset(sessions, 0, sizeof(sessions));
+}
+
+// Compare a given value with an expected one, in a time not depending on where they differ
+static bool equalsConstantTime(const String &value, const String &expected) {
+	uint8_t difference = value.length() != expected.length();
+	for (size_t i = 0; i < expected.length(); i++) {
+		difference |= ((i < value.length()) ? value[i] : 0) ^ expected[i];
+	}
+	return !difference;
+}
+
+/*
+
+	Open a session, if user is authenticated by Basic authentication or user and password POST arguments
+
+	Answers with a session cookie and a redirection to url argument (or /).
+		Only local paths are accepted as url (not //host or /\host, that browsers take as another site).
+
+*/
+void AsyncFFWebServer::handleLogin(AsyncWebServerRequest *request) {
+	String target = request->hasArg("url") ? request->arg("url") : String("/");
+	if (!target.startsWith("/") || target.startsWith("//") || target.startsWith("/\\")) {
+		target = "/";
 	}
+	if (!_httpAuth.auth) {
+		metricsResponse(302);
+		return request->redirect(target);
+	}
+	bool valid = request->authenticate(_httpAuth.wwwUsername.c_str(), _httpAuth.wwwPassword.c_str());
+	// Form credentials are only accepted in POST body, to keep them out of URLs (history, logs)
+	if (!valid && request->hasParam("user", true) && request->hasParam("password", true)) {
+		// Compare both values, without stopping at first difference
+		bool userValid = equalsConstantTime(request->getParam("user", true)->value(), _httpAuth.wwwUsername);
+		bool passwordValid = equalsConstantTime(request->getParam("password", true)->value(), _httpAuth.wwwPassword);
+		valid = userValid && passwordValid;
+	}
+	if (!valid) {
+		return requestAuth(request);
+	}
+	AsyncWebServerResponse *response = request->beginResponse(302);
+	response->addHeader("Location", target);
+	response->addHeader("Set-Cookie", String(F(FF_SESSION_COOKIE "=")) + createSession()
+		+ F("; Path=/; HttpOnly; SameSite=Strict; Max-Age=") + String(FF_SESSION_DURATION));
+	metricsResponse(302);
+	request->send(response);
+}
+
+// Close session of request cookie, and remove cookie
+void AsyncFFWebServer::handleLogout(AsyncWebServerRequest *request) {
+	ffSession_t *session = findSession(request);
+	if (session) {
+		memset(session, 0, sizeof(ffSession_t));
+	}
+	AsyncWebServerResponse *response = request->beginResponse(302);
+	response->addHeader("Location", "/");
+	response->addHeader("Set-Cookie", F(FF_SESSION_COOKIE "=; Path=/; Max-Age=0"));
+	metricsResponse(302);
+	request->send(response);
 }
 
 /*!
@@ -2301,6 +5377,55 @@ AsyncFFWebServer& AsyncFFWebServer::setConfigChangedCallback(CONFIG_CHANGED_CALL
 	return *this;
 }
 
+/*!
+
+	Set configuration key change callback
+
+	Called once for each user's configuration key whose value changed, after file has been written
+		(at end of transaction if one is opened). Configuration change callback is then called once.
+
+	\param[in]	Address of user routine to be called with key name, old and new value
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::setConfigKeyChangedCallback(CONFIG_KEY_CHANGED_CALLBACK_SIGNATURE) {
+	this->configKeyChangedCallback = configKeyChangedCallback;
+	return *this;
+}
+
+/*!
+
+	Set Cache-Control header sent with files matching a pattern
+
+	Files are always sent with an ETag. Browser will check it before using its copy
+		if no rule matches (or max age is 0), and will use its copy without asking during max age seconds else.
+	Rules are checked in definition order, first matching one is used.
+
+	\param[in]	pattern: exact path (/index.htm), extension (*.css) or path start (/img/*)
+	\param[in]	maxAge: seconds browser may use its copy without checking. 0 to always check, -1 to never keep a copy
+	\return	A pointer to this class instance
+
+*/
+AsyncFFWebServer& AsyncFFWebServer::setCacheControl(const char *pattern, const long maxAge) {
+	uint8_t i;
+	// Update existing rule, else add it
+	for (i = 0; i < cacheRuleCount; i++) {
+		if (cacheRules[i].pattern == pattern) {
+			break;
+		}
+	}
+	if (i >= FF_CACHE_CONTROL_RULES) {
+		DEBUG_ERROR_P("Too many cache rules, %s ignored", pattern);
+		return *this;
+	}
+	cacheRules[i].pattern = pattern;
+	cacheRules[i].maxAge = maxAge;
+	if (i == cacheRuleCount) {
+		cacheRuleCount++;
+	}
+	return *this;
+}
+
 /*!
 
 	Set Serial command callback
@@ -2578,6 +5703,14 @@ void AsyncFFWebServer::executeCommand(const String command) {
 			trace_info_P("syslogServer=%s", FF_WebServer.syslogServer.c_str());
 			trace_info_P("syslogPort=%d", FF_WebServer.syslogPort);
 		#endif
+		trace_info_P("configLoadPeakHeap=%u", FF_WebServer.configLoadPeakHeap);
+		trace_info_P("fileIndex=%u entries", FF_WebServer.fileIndex.size());
+		trace_info_P("userConfigCache: hits=%lu, fileReads=%lu, fileWrites=%lu", FF_WebServer.userConfigCacheHits, FF_WebServer.userConfigFileReads, FF_WebServer.userConfigFileWrites);
+		FF_WebServer.dumpConnections();
+	} else if (command.equalsIgnoreCase("metrics")) {
+		FF_WebServer.dumpMetrics();
+	} else if (command.equalsIgnoreCase("cfgbench")) {
+		FF_WebServer.benchmarkConfigFormats();
 	} else if (command.equalsIgnoreCase("debug")) {
 		FF_WebServer.debugFlag = !FF_WebServer.debugFlag;
 		trace_info_P("Debug is now %d", FF_WebServer.debugFlag);
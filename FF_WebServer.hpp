@@ -31,7 +31,9 @@
 #endif
 
 #include <Hash.h>
+#include <vector>
 #include <FS.h>
+#include <MD5Builder.h>
 #include <WiFiClient.h>
 #include <Time.h>
 #include <TimeLib.h>
@@ -45,6 +47,7 @@
 #include <NtpClientLib.h>									// https://github.com/gmag11/NtpClient
 #include <ESPAsyncWebServer.h>								// https://github.com/me-no-dev/ESPAsyncWebServer
 #include <ArduinoJson.h>									// https://github.com/bblanchon/ArduinoJson
+#include <bearssl/bearssl_hmac.h>						// HMAC of session cookies
 #include <AsyncMqttClient.h>								// https://github.com/marvinroger/async-mqtt-client
 #include <FF_Trace.h>										// https://github.com/FlyingDomotic/FF_Trace
 
@@ -77,10 +80,85 @@
 // #define HIDE_CONFIG
 #define CONFIG_FILE "/config.json"
 #define USER_CONFIG_FILE "/userconfig.json"
+#define USER_CONFIG_UI_FILE "/userconfigui.json"
 #define SECRET_FILE "/secret.json"
+#ifndef FF_CACHE_CONTROL_RULES
+	#define FF_CACHE_CONTROL_RULES 8						// Maximum number of Cache-Control rules
+#endif
+#ifndef FF_PUSH_VALUES_INTERVAL
+	#define FF_PUSH_VALUES_INTERVAL 500						// Minimum interval between two pushes of changed values (ms)
+#endif
+#ifndef FF_BIND_CHECK_INTERVAL
+	#define FF_BIND_CHECK_INTERVAL 250						// Interval between two checks of bound values changes (ms)
+#endif
+#ifndef FF_FILE_MISS_CACHE
+	#define FF_FILE_MISS_CACHE 8							// Number of paths remembered as not found on file system
+#endif
+#ifndef FF_FILE_MISS_TTL
+	#define FF_FILE_MISS_TTL 10000							// Time before searching again a path not found on file system (ms)
+#endif
+#ifndef FF_WIFI_SCAN_INTERVAL
+	#define FF_WIFI_SCAN_INTERVAL 30000						// Minimum interval between two Wi-Fi scans (ms)
+#endif
+#ifndef FF_ADMISSION_MIN_HEAP
+	#define FF_ADMISSION_MIN_HEAP 8192						// Reject non critical requests when free heap is lower (bytes)
+#endif
+#ifndef FF_ADMISSION_MIN_BLOCK
+	#define FF_ADMISSION_MIN_BLOCK 4096						// Reject non critical requests when largest free block is lower (bytes)
+#endif
+#ifndef FF_ADMISSION_MAX_IN_FLIGHT
+	#define FF_ADMISSION_MAX_IN_FLIGHT 4					// Reject non critical requests when this number of requests are in progress
+#endif
+#ifndef FF_ADMISSION_RETRY_AFTER
+	#define FF_ADMISSION_RETRY_AFTER 2						// Retry-After value sent with rejected requests (s)
+#endif
+#ifndef FF_CONN_MAX
+	#define FF_CONN_MAX 5									// Maximum number of supervised connections (oldest idle one is closed above, else new one)
+#endif
+#ifndef FF_CONN_HEADER_TIMEOUT
+	#define FF_CONN_HEADER_TIMEOUT 5000						// Maximum time to receive request headers (ms)
+#endif
+#ifndef FF_CONN_BODY_TIMEOUT
+	#define FF_CONN_BODY_TIMEOUT 10000						// Maximum time without receiving request body data (ms)
+#endif
+#ifndef FF_CONN_WRITE_TIMEOUT
+	#define FF_CONN_WRITE_TIMEOUT 10000						// Maximum time without client acknowledging sent data (ms)
+#endif
+#ifndef FF_UPLOAD_CONTEXTS
+	#define FF_UPLOAD_CONTEXTS 2							// Maximum number of simultaneous /edit uploads
+#endif
+#ifndef FF_UPLOAD_BLOCK_SIZE
+	#define FF_UPLOAD_BLOCK_SIZE 4096						// Size of RAM buffer used to write uploaded files by blocks (bytes)
+#endif
+#ifndef FF_RATE_LIMIT_RULES
+	#define FF_RATE_LIMIT_RULES 4							// Maximum number of rate limit rules (RateLimits key)
+#endif
+#ifndef FF_RATE_LIMIT_CLIENTS
+	#define FF_RATE_LIMIT_CLIENTS 8							// Number of (client, rule) token buckets kept (least recently used is reused)
+#endif
+#ifndef FF_RESPONSE_CACHE_RULES
+	#define FF_RESPONSE_CACHE_RULES 4						// Maximum number of URLs kept in response cache
+#endif
+#ifndef FF_RESPONSE_CACHE_SIZE
+	#define FF_RESPONSE_CACHE_SIZE 2048						// Maximum total size of responses kept in cache (bytes)
+#endif
+#ifndef FF_ROUTE_MAX_PARAMS
+	#define FF_ROUTE_MAX_PARAMS 4							// Maximum number of parameters in a route path
+#endif
+#ifndef FF_SESSION_COUNT
+	#define FF_SESSION_COUNT 4								// Maximum number of simultaneous login sessions
+#endif
+#ifndef FF_SESSION_DURATION
+	#define FF_SESSION_DURATION 3600						// Validity of login session cookies (s)
+#endif
+#define FF_SESSION_COOKIE "FFSESSION"						// Name of session cookie
+#define FF_SESSION_ID_SIZE 8								// Size of session random id (bytes)
+#define FF_SESSION_MAC_SIZE 32								// Size of session cookie HMAC-SHA256 (bytes)
+#define CONFIG_BINARY_EXTENSION ".mpk"						// Extension of configuration files when FF_CONFIG_USE_MSGPACK is defined
 
 //	Define all callback signatures
 #define CONFIG_CHANGED_CALLBACK_SIGNATURE std::function<void(void)> configChangedCallback
+#define CONFIG_KEY_CHANGED_CALLBACK_SIGNATURE std::function<void(const char *key, const char *oldValue, const char *newValue)> configKeyChangedCallback
 #define DEBUG_COMMAND_CALLBACK_SIGNATURE std::function<bool(const String command)> debugCommandCallback
 #define HELP_MESSAGE_CALLBACK_SIGNATURE std::function<String(void)> helpMessageCallback
 #ifndef NO_SERIAL_COMMAND_CALLBACK
@@ -96,6 +174,7 @@
 #define MQTT_CONNECT_CALLBACK_SIGNATURE std::function<void(void)> mqttConnectCallback
 #define MQTT_DISCONNECT_CALLBACK_SIGNATURE std::function<void(AsyncMqttClientDisconnectReason disconnectReason)> mqttDisconnectCallback
 #define MQTT_MESSAGE_CALLBACK_SIGNATURE std::function<void(const char *topic, const char *payload, const AsyncMqttClientMessageProperties properties, const size_t len, const size_t index, const size_t total)> mqttMessageCallback
+#define ROUTE_CALLBACK_SIGNATURE std::function<void(AsyncWebServerRequest *request, FF_RouteParams &params)> routeCallback
 
 // Define all callbacks
 #define CONFIG_CHANGED_CALLBACK(routine) void routine(void)
@@ -114,6 +193,7 @@
 #define MQTT_CONNECT_CALLBACK(routine) void routine(void)
 #define MQTT_DISCONNECT_CALLBACK(routine) void routine(AsyncMqttClientDisconnectReason disconnectReason)
 #define MQTT_MESSAGE_CALLBACK(routine) void routine(const char *topic, const char *payload, const AsyncMqttClientMessageProperties properties, const size_t len, const size_t index, const size_t total)
+#define ROUTE_CALLBACK(routine) void routine(AsyncWebServerRequest *request, FF_RouteParams &params)
 
 typedef struct {
 	String ssid;
@@ -142,12 +222,300 @@ typedef struct {
 	String wwwPassword;
 } strHTTPAuth;
 
+#define FF_FILE_PLAIN 1										// File exists with its own name
+#define FF_FILE_GZ 2										// File exists in compressed (.gz) version
+typedef struct {
+	uint32_t hash;											// FNV-1a hash of file path
+	uint32_t check;											// djb2 hash of file path (to detect hash collisions)
+	uint32_t size;											// Size of file to send (compressed one if existing)
+	uint8_t flags;											// FF_FILE_xxx flags
+	uint8_t contentType;									// Index of content type
+} ffFileIndex_t;
+
+typedef struct {
+	uint32_t hash;											// FNV-1a hash of path not found on file system
+	unsigned long time;										// Time of last search (millis)
+} ffFileMiss_t;
+
+#define FF_BIND_REST 1										// Bound value is sent in /rest/values
+#define FF_BIND_JSON 2										// Bound value is sent in /json/values
+#define FF_BIND_MQTT 4										// Bound value is published on MQTT when changed
+#define FF_BIND_PUSH 8										// Bound value is pushed to index.htm when changed
+#define FF_BIND_INPUT 16									// Bound value is sent as input (instead of div) in /rest/values
+#define FF_BIND_ALL (FF_BIND_REST | FF_BIND_JSON | FF_BIND_MQTT | FF_BIND_PUSH)
+
+typedef enum {
+	FF_BIND_INT,
+	FF_BIND_LONG,
+	FF_BIND_ULONG,
+	FF_BIND_FLOAT,
+	FF_BIND_BOOL,
+	FF_BIND_CHARS,
+	FF_BIND_STRING
+} ffBindType_t;
+
+typedef struct {
+	const char *name;										// Value name (also MQTT subtopic)
+	const void *value;										// Address of value
+	ffBindType_t type;										// Type of value
+	uint8_t flags;											// FF_BIND_xxx flags
+	const char *format;										// printf format, NULL for default
+	float deadband;											// Minimum change of numeric value to publish it
+	double lastValue;										// Last published numeric value
+	String lastText;										// Last published text value
+	bool published;											// Value has already been published
+	bool mqttPending;										// Last change still has to be published on MQTT
+} ffBoundValue_t;
+
+typedef struct {
+	uint8_t id[FF_SESSION_ID_SIZE];							// Random session id
+	uint32_t created;										// Creation time (millis)
+	bool active;											// Session is opened
+} ffSession_t;
+
+typedef struct {
+	String url;												// Cached URL
+	unsigned long ttl;										// Time to live of cached response (ms)
+	String contentType;										// Content type of cached response
+	String body;											// Cached response (empty if none)
+	unsigned long time;										// Time response was cached (millis)
+} ffCachedResponse_t;
+
+typedef struct {
+	AsyncWebServerRequest *request;							// Uploading request (NULL if unused)
+	AsyncClient *client;									// Client of request, to abort upload on disconnection
+	File file;												// Temporary file written during upload
+	char tempPath[16];										// Temporary file name
+	String path;											// Final file name
+	uint8_t *buffer;										// Block buffer (NULL to write chunks directly)
+	size_t used;											// Bytes used in buffer
+	size_t size;											// Bytes received
+	uint32_t writes;										// Number of file writes
+	MD5Builder md5;											// MD5 of received data
+	unsigned long startTime;								// Upload start time (millis)
+	bool complete;											// File received, waiting for request handler to replace target
+} ffUploadContext_t;
+
+typedef enum {
+	FF_CONN_HEADERS,										// Receiving request headers
+	FF_CONN_BODY,											// Receiving request body
+	FF_CONN_SENDING											// Handler called, sending answer
+} ffConnectionState_t;
+
+typedef enum {
+	FF_CLOSE_HEADER,										// Headers not received in time
+	FF_CLOSE_BODY,											// Body not received in time
+	FF_CLOSE_WRITE,											// Sent data not acknowledged in time
+	FF_CLOSE_EVICTED,										// Oldest idle connection closed for a new one
+	FF_CLOSE_REFUSED,										// New connection closed, no idle one to evict
+	FF_CLOSE_REASONS										// Number of close reasons
+} ffCloseReason_t;
+
+typedef struct {
+	AsyncClient *client;									// Supervised client (NULL if unused)
+	unsigned long acceptTime;								// Connection time (millis)
+	unsigned long lastActivity;								// Last time connection made progress (millis)
+	size_t fullSpace;										// Send buffer space when nothing is pending
+	size_t space;											// Send buffer space at last check
+	ffConnectionState_t state;								// Connection state
+	bool inFlight;											// Request handler has been called (counted by requestsInFlight())
+} ffConnection_t;
+
+typedef struct {
+	char prefix[24];										// URL prefix
+	uint16_t perMinute;										// Requests allowed per minute
+	uint8_t burst;											// Requests allowed at once
+} ffRateRule_t;
+
+typedef struct {
+	uint32_t ip;											// Client IP address (0 if unused)
+	uint8_t rule;											// Index of rule
+	uint32_t tokens;										// Available tokens (1/1000 of request)
+	unsigned long lastRefill;								// Last refill time (millis), also used to find least recently used bucket
+} ffRateBucket_t;
+
+#define FF_METRICS_BUCKETS 7								// Number of handler time histogram buckets
+#define FF_METRICS_CLASSES 5								// Number of status classes (2xx, 3xx, 4xx, 5xx, other)
+
+typedef struct {
+	const char *route;										// Route name
+	uint32_t count;											// Number of requests
+	uint32_t classes[FF_METRICS_CLASSES];					// Requests per status class (2xx, 3xx, 4xx, 5xx, other)
+	uint32_t bytes;											// Known bytes sent
+	uint32_t buckets[FF_METRICS_BUCKETS];					// Requests per handler time bucket
+	uint32_t maxTime;										// Maximum handler time (us)
+	uint64_t totalTime;										// Total handler time (us)
+	int32_t minHeapDelta;									// Largest free heap decrease during handler (bytes)
+} ffRouteMetrics_t;
+
+typedef struct {
+	String name;											// Value name (id of HTML element)
+	String value;											// Last value
+	String type;											// Value type (div, input, chk)
+	bool dirty;												// Value changed since last push
+} ffPushValue_t;
+
+typedef struct {
+	String ssid;
+	String bssid;
+	int32_t rssi;
+	uint8_t channel;
+	uint8_t encryption;
+	bool hidden;
+} ffWifiNetwork_t;
+
+typedef struct {
+	const char *path;										// File path (in PROGMEM)
+	const uint8_t *data;									// Gzipped file content (in PROGMEM)
+	uint32_t length;										// Gzipped file length
+	const char *etag;										// Precomputed ETag (in PROGMEM)
+} ffEmbeddedAsset_t;
+
+typedef struct {
+	String pattern;											// Exact path, extension (*.css) or path start (/img/*)
+	long maxAge;											// Max age in seconds (0: no-cache, -1: no-store)
+} ffCacheRule_t;
+
 typedef enum {
 	FS_STAT_CONNECTING,
 	FS_STAT_CONNECTED,
 	FS_STAT_APMODE
 } enWifiStatus;
 
+// ----- Routes -----
+typedef enum {
+	FF_AUTH_INHERIT,										// Use policy of parent path
+	FF_AUTH_NONE,											// No authentication needed
+	FF_AUTH_REQUIRED										// Authentication needed (if enabled)
+} ffAuthPolicy_t;
+
+typedef enum {
+	FF_ROUTE_LITERAL,										// Fixed text
+	FF_ROUTE_TEXT,											// {name} parameter
+	FF_ROUTE_INT,											// {name:int} parameter
+	FF_ROUTE_TAIL											// * (rest of path, maybe empty)
+} ffRouteSegment_t;
+
+typedef struct {
+	uint32_t hash;											// Hash of literal segment
+	String segment;											// Literal segment or parameter name
+	ffRouteSegment_t kind;									// Segment kind
+	ffAuthPolicy_t auth;									// Authentication policy inherited by routes of this path and longer ones
+	int16_t paramChild;										// Index of parameter child node (-1 if none)
+	int16_t tailChild;										// Index of tail child node (-1 if none)
+	std::vector<uint16_t> children;							// Index of literal child nodes, sorted on hash
+	std::vector<uint16_t> routes;							// Index of routes ending at this node
+} ffRouteNode_t;
+
+class AsyncFFWebServer;
+
+// Path parameters of a route, pointing into request URL (no copy)
+class FF_RouteParams {
+public:
+	uint8_t count(void) const;
+	const char *name(const uint8_t index) const;
+	int find(const char *name) const;
+	bool has(const char *name) const;
+	bool equals(const char *name, const char *value) const;
+	long getInt(const char *name, const long defaultValue = 0) const;
+	size_t get(const char *name, char *buffer, const size_t size) const;
+	String getString(const char *name) const;
+protected:
+	friend class AsyncFFWebServer;
+	uint8_t _count = 0;
+	const char *_names[FF_ROUTE_MAX_PARAMS];
+	const char *_values[FF_ROUTE_MAX_PARAMS];
+	uint8_t _lengths[FF_ROUTE_MAX_PARAMS];
+	void add(const char *name, const char *value, const size_t length);
+};
+
+typedef struct {
+	WebRequestMethodComposite method;						// Accepted methods
+	ffAuthPolicy_t auth;									// Authentication policy (FF_AUTH_INHERIT to use path one)
+	ROUTE_CALLBACK_SIGNATURE;								// User's handler
+	ArRequestHandlerFunction metered;						// Handler with metrics and authentication
+} ffRoute_t;
+
+// ESPAsyncWebServer handler dispatching requests to routes
+class FF_RouteHandler : public AsyncWebHandler {
+public:
+	AsyncFFWebServer *server = NULL;
+	bool canHandle(AsyncWebServerRequest *request) override;
+	void handleRequest(AsyncWebServerRequest *request) override;
+	bool isRequestHandlerTrivial() override {return false;}
+protected:
+	AsyncWebServerRequest *lastRequest = NULL;				// Last request given to canHandle()
+	int lastIndex = -1;										// Route found for last request (-1 if none)
+	FF_RouteParams lastParams;								// Path parameters of last request
+	ffAuthPolicy_t lastAuth = FF_AUTH_NONE;					// Authentication policy of last request
+};
+
+// ----- Values response -----
+// Writes "name|value|type" lines (read by setValues() in microajax.js) directly into response, without temporary Strings
+
+// Print writing to another Print, keeping a copy of written data if asked (up to a limit)
+class FF_TeePrint : public Print {
+public:
+	Print *output = NULL;									// Print to write to
+	String *copy = NULL;									// String keeping a copy (NULL for no copy)
+	size_t copyLimit = 0;									// Stop copying (and clear copy) above this size
+	size_t count = 0;										// Number of bytes written
+	size_t write(uint8_t c) override;
+	size_t write(const uint8_t *buffer, size_t size) override;
+protected:
+	void keep(const uint8_t *buffer, size_t size);
+};
+
+class FF_ValuesResponse {
+public:
+	FF_ValuesResponse(AsyncWebServerRequest *request);
+	FF_ValuesResponse& add(PGM_P name, const char *value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const String &value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const __FlashStringHelper *value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const int value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const unsigned int value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const long value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const unsigned long value, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const float value, const int digits = 2, PGM_P type = "div");
+	FF_ValuesResponse& add(PGM_P name, const IPAddress &value, PGM_P type = "div");
+	FF_ValuesResponse& addChecked(PGM_P name, const bool checked);
+	FF_ValuesResponse& addOctets(PGM_P prefix, const IPAddress &value, PGM_P type = "input");
+	AsyncResponseStream *getStream(void);
+	void send(void);
+protected:
+	AsyncWebServerRequest *_request;
+	AsyncResponseStream *_stream;
+	FF_TeePrint _out;										// Writes to _stream, keeping a copy if URL is cached
+	String _copy;											// Copy of response, if URL is cached
+	void start(PGM_P name);
+	void end(PGM_P type);
+};
+
+// ----- Typed configuration -----
+typedef enum {
+	FF_CONFIG_STRING,										// Fixed size char array
+	FF_CONFIG_INT,											// int
+	FF_CONFIG_LONG,											// long
+	FF_CONFIG_BOOL,											// bool
+	FF_CONFIG_FLOAT,										// float
+	FF_CONFIG_IP											// IP address, stored as uint32_t
+} ffConfigType_t;
+
+typedef struct {
+	const char *name;										// Key name in userconfig.json
+	uint32_t hash;											// FNV-1a hash of name
+	ffConfigType_t type;									// Value type
+	size_t offset;											// Offset of value in configuration structure
+	size_t size;											// Size of value in configuration structure
+} ffConfigKey_t;
+
+// Compute FNV-1a hash of a key name (at compile time for constant names)
+constexpr uint32_t ffConfigHash(const char *name, const uint32_t hash = 2166136261UL) {
+	return *name ? ffConfigHash(name + 1, (uint32_t) ((hash ^ (uint8_t) *name) * 16777619UL)) : hash;
+}
+
+#include "FF_WebServerSchema.h"								// Built-in configuration keys
+
 class AsyncFFWebServer : public AsyncWebServer {
 public:
 	AsyncFFWebServer(uint16_t port);
@@ -165,6 +533,35 @@ public:
 
 	// Set callbacks
 	AsyncFFWebServer& setConfigChangedCallback(CONFIG_CHANGED_CALLBACK_SIGNATURE);
+	AsyncFFWebServer& setConfigKeyChangedCallback(CONFIG_KEY_CHANGED_CALLBACK_SIGNATURE);
+	AsyncFFWebServer& setCacheControl(const char *pattern, const long maxAge);
+	AsyncFFWebServer& setWifiScanInterval(const unsigned long interval);
+	AsyncFFWebServer& setAdmissionLimits(const uint32_t minHeap, const uint32_t minBlock, const uint8_t maxInFlight);
+	AsyncFFWebServer& setConnectionTimeouts(const unsigned long headerTimeout, const unsigned long bodyTimeout, const unsigned long writeTimeout);
+	AsyncFFWebServer& setResponseCache(const char *url, const unsigned long ttl);
+	AsyncFFWebServer& route(const char *pattern, const WebRequestMethodComposite method, const ffAuthPolicy_t auth, ROUTE_CALLBACK_SIGNATURE);
+	AsyncFFWebServer& keepRequestHeader(const char *name);
+	void sendResponse(AsyncWebServerRequest *request, const char *contentType, const String &body);
+	void sendResponse(AsyncWebServerRequest *request, const int code, const char *contentType, const String &body);
+	void metricsResponse(const int code, const size_t length = 0);
+	void onRequestDisconnect(AsyncWebServerRequest *request, ArDisconnectHandler handler);
+	bool isResponseCached(AsyncWebServerRequest *request);
+	void storeCachedResponse(AsyncWebServerRequest *request, const char *contentType, const String &body);
+	void requestWifiScan(void);
+	void pushValue(const char *name, const String &value, const char *type = "div");
+	void bindValue(const char *name, const int *value, const uint8_t flags = FF_BIND_ALL, const char *format = NULL, const float deadband = 0);
+	void bindValue(const char *name, const long *value, const uint8_t flags = FF_BIND_ALL, const char *format = NULL, const float deadband = 0);
+	void bindValue(const char *name, const unsigned long *value, const uint8_t flags = FF_BIND_ALL, const char *format = NULL, const float deadband = 0);
+	void bindValue(const char *name, const float *value, const uint8_t flags = FF_BIND_ALL, const char *format = NULL, const float deadband = 0);
+	void bindValue(const char *name, const bool *value, const uint8_t flags = FF_BIND_ALL);
+	void bindValue(const char *name, const char *value, const uint8_t flags = FF_BIND_ALL);
+	void bindValue(const char *name, const String *value, const uint8_t flags = FF_BIND_ALL);
+	void pushValue(const char *name, const char *value, const char *type = "div");
+	void pushValue(const char *name, const long value, const char *type = "div");
+	void pushValue(const char *name, const int value, const char *type = "div");
+	void pushValue(const char *name, const unsigned int value, const char *type = "div");
+	void pushValue(const char *name, const unsigned long value, const char *type = "div");
+	void pushValue(const char *name, const double value, const int digits = 2, const char *type = "div");
 	AsyncFFWebServer& setDebugCommandCallback(DEBUG_COMMAND_CALLBACK_SIGNATURE);
 	AsyncFFWebServer& setHelpMessageCallback(HELP_MESSAGE_CALLBACK_SIGNATURE);
 	#ifndef NO_SERIAL_COMMAND_CALLBACK
@@ -189,6 +586,12 @@ public:
 	bool load_user_config(String name, float &value);
 	bool save_user_config(String name, long value);
 	bool load_user_config(String name, long &value);
+	void beginUserConfigTransaction(void);
+	bool commitUserConfigTransaction(void);
+	bool load_user_config(const ffConfigKey_t *keys, const size_t count, void *values);
+	bool load_user_config(const ffConfigKey_t *keys, const size_t count, void *values, const char *name);
+	bool save_user_config(const ffConfigKey_t *keys, const size_t count, const void *values);
+	int findUserConfigKey(const ffConfigKey_t *keys, const size_t count, const char *name);
 	String urldecode(String input); // (based on https://code.google.com/p/avr-netino/)
 	void sendTimeData();
 	void configureWifiAP();
@@ -224,6 +627,7 @@ public:
 protected:
 	// Callbacks
 	CONFIG_CHANGED_CALLBACK_SIGNATURE;
+	CONFIG_KEY_CHANGED_CALLBACK_SIGNATURE;
 	DEBUG_COMMAND_CALLBACK_SIGNATURE;
 	HELP_MESSAGE_CALLBACK_SIGNATURE;
 	#ifndef NO_SERIAL_COMMAND_CALLBACK
@@ -240,6 +644,10 @@ protected:
 	MQTT_DISCONNECT_CALLBACK_SIGNATURE;
 	MQTT_MESSAGE_CALLBACK_SIGNATURE;
 
+	// ----- Built-in configuration -----
+	ffBuiltinConfig_t builtinConfig;						// Typed copy of built-in keys
+	bool loadUserConfigValue(const ffConfigKey_t *key, void *values);
+
 	// ----- MQTT -----
 	AsyncMqttClient mqttClient;
 	unsigned long lastMqttConnectTime = 0;
@@ -273,6 +681,175 @@ protected:
 		unsigned long traceKeepAlive = FF_TRACE_KEEP_ALIVE;
 	#endif
 
+	// ----- User config cache -----
+	JsonDocument userConfigDoc;								// Parsed content of userconfig.json, kept in RAM
+	bool userConfigLoaded = false;							// Cache has been loaded from file
+	bool userConfigValid = false;							// Cache content comes from a valid userconfig.json file
+	bool userConfigDirty = false;							// Cache has been modified since last write
+	uint8_t userConfigTransactionDepth = 0;					// Number of nested opened transactions
+	unsigned long userConfigCacheHits = 0;					// Count of user config reads served from cache
+	unsigned long userConfigFileReads = 0;					// Count of userconfig.json reads
+	unsigned long userConfigFileWrites = 0;					// Count of userconfig.json writes
+	JsonDocument userConfigChanges;							// Keys modified since last notification, with their previous value
+	bool userConfigNotifying = false;						// Change callbacks are being called
+	void notifyUserConfigChanges(void);
+	void notifyUserConfigKeys(const JsonDocument &changes);
+
+	// ----- Static files cache control -----
+	ffCacheRule_t cacheRules[FF_CACHE_CONTROL_RULES];		// Cache-Control rules
+	uint8_t cacheRuleCount = 0;								// Count of defined rules
+	String getCacheControl(const String &path);
+
+	// ----- Values pushed on /events -----
+	std::vector<ffPushValue_t> pushValues;					// Values pushed to index.htm
+	bool pushValuesDirty = false;							// At least one value changed since last push
+	unsigned long pushValuesLastSend = 0;					// Last push time (millis)
+	String formatPushValues(const bool all);
+	void servicePushValues(void);
+
+	// ----- Bound values -----
+	std::vector<ffBoundValue_t> boundValues;				// Values bound by bindValue()
+	unsigned long boundValuesLastCheck = 0;					// Last check of bound values changes (millis)
+	void addBoundValue(const char *name, const void *value, const ffBindType_t type, const uint8_t flags, const char *format, const float deadband);
+	String formatBoundValue(const ffBoundValue_t &binding);
+	double numericBoundValue(const ffBoundValue_t &binding);
+	bool boundValueChanged(const ffBoundValue_t &binding);
+	void serviceBoundValues(void);
+	bool sendBoundValuesRest(AsyncWebServerRequest *request);
+	bool sendBoundValuesJson(AsyncWebServerRequest *request);
+
+	// ----- Request metrics -----
+	std::vector<ffRouteMetrics_t> routeMetrics;				// Metrics of each instrumented route
+	int metricsCode = 0;									// Status code of request being handled (0 if unknown)
+	size_t metricsBytes = 0;								// Length of answer of request being handled
+	ArRequestHandlerFunction metered(const char *route, ArRequestHandlerFunction handler, const bool critical = false);
+	void recordRouteMetrics(const size_t index, const uint32_t duration, const int32_t heapDelta);
+	void requestAuth(AsyncWebServerRequest *request);
+	void handleMetrics(AsyncWebServerRequest *request);
+	void dumpMetrics(void);
+
+	// ----- Admission control -----
+	uint32_t admissionMinHeap = FF_ADMISSION_MIN_HEAP;		// Minimum free heap to admit a non critical request (bytes)
+	uint32_t admissionMinBlock = FF_ADMISSION_MIN_BLOCK;	// Minimum largest free block to admit a non critical request (bytes)
+	uint8_t admissionMaxInFlight = FF_ADMISSION_MAX_IN_FLIGHT;	// Maximum requests in progress to admit a non critical request
+	uint32_t rejectedHeap = 0;								// Requests rejected for low free heap
+	uint32_t rejectedBlock = 0;								// Requests rejected for low largest free block
+	uint32_t rejectedInFlight = 0;							// Requests rejected for too many requests in progress
+	AsyncWebServerRequest *eventsRejected = NULL;			// Event source request refused by admission (to be answered with 503)
+	uint32_t *eventsRejection = NULL;						// Rejection counter of refused event source request
+	bool admitRequest(AsyncWebServerRequest *request);
+	uint32_t *admissionCounter(void);
+	void rejectRequest(AsyncWebServerRequest *request, uint32_t *counter);
+
+	// ----- Connection supervisor -----
+	ffConnection_t connections[FF_CONN_MAX];				// Supervised connections
+	ArDisconnectHandler connectionDisconnects[FF_CONN_MAX];	// User's request disconnect callbacks, per connection
+	uint32_t connectionCloses[FF_CLOSE_REASONS];			// Connections closed by supervisor, per reason
+	unsigned long connHeaderTimeout = FF_CONN_HEADER_TIMEOUT;	// Maximum time to receive request headers (ms)
+	unsigned long connBodyTimeout = FF_CONN_BODY_TIMEOUT;	// Maximum time without receiving body data (ms)
+	unsigned long connWriteTimeout = FF_CONN_WRITE_TIMEOUT;	// Maximum time without sent data acknowledgment (ms)
+	void acceptConnection(AsyncClient *client);
+	ffConnection_t *findConnection(AsyncClient *client);
+	void releaseConnection(AsyncClient *client);
+	void requestDisconnected(AsyncClient *client);
+	bool isIdleConnection(ffConnection_t *connection);
+	void closeConnection(ffConnection_t *connection, const ffCloseReason_t reason);
+	void connectionActivity(AsyncWebServerRequest *request, const ffConnectionState_t state);
+	uint8_t openConnections(void);
+	uint8_t requestsInFlight(void);
+	void dumpConnections(void);
+	void serviceConnections(void);
+
+	// ----- File upload -----
+	ffUploadContext_t uploads[FF_UPLOAD_CONTEXTS];			// Uploads in progress
+	ffUploadContext_t *startUpload(AsyncWebServerRequest *request, String filename);
+	bool writeUpload(ffUploadContext_t *upload, const uint8_t *data, const size_t len);
+	void finishUpload(ffUploadContext_t *upload);
+	void commitUploads(AsyncWebServerRequest *request);
+	void abortUpload(ffUploadContext_t *upload);
+	void releaseUpload(ffUploadContext_t *upload);
+	void setUploadError(AsyncWebServerRequest *request, const char *message);
+
+	// ----- Routes -----
+	friend class FF_RouteHandler;
+	FF_RouteHandler routeHandler;							// Handler dispatching requests to routes
+	std::vector<ffRouteNode_t> routeNodes;					// Route tree, first node is root
+	std::vector<ffRoute_t> routes;							// Registered routes
+	std::vector<const char *> keptHeaders;					// Request headers kept for user's code (keepRequestHeader())
+	FF_RouteParams currentRouteParams;						// Parameters of route being executed
+	ffAuthPolicy_t currentRouteAuth = FF_AUTH_NONE;			// Authentication policy of route being executed
+	uint16_t addRouteNode(const uint16_t parent, const char *segment, const size_t length);
+	size_t findRouteChild(const std::vector<uint16_t> &children, const uint32_t hash);
+	int matchRoute(const String &url, FF_RouteParams &params, ffAuthPolicy_t &auth);
+	int findRoute(AsyncWebServerRequest *request, FF_RouteParams &params, ffAuthPolicy_t &auth);
+
+	// ----- Login sessions -----
+	ffSession_t sessions[FF_SESSION_COUNT];					// Opened sessions
+	uint8_t sessionKey[32];									// HMAC key of session cookies (random, changed at each boot)
+	bool sessionKeyLoaded = false;							// Session key has been generated
+	void computeSessionMac(const uint8_t *id, const uint32_t created, uint8_t *mac);
+	ffSession_t *findSession(AsyncWebServerRequest *request);
+	String createSession(void);
+	void clearSessions(void);
+	void handleLogin(AsyncWebServerRequest *request);
+	void handleLogout(AsyncWebServerRequest *request);
+
+	// ----- Response cache -----
+	ffCachedResponse_t cachedResponses[FF_RESPONSE_CACHE_RULES];	// Cached URLs and their last response
+	uint8_t cachedResponseCount = 0;						// Number of cached URLs
+	uint32_t responseCacheHits = 0;							// Requests answered from cache
+	uint32_t responseCacheMisses = 0;						// Requests to cached URLs answered by callback
+	ffCachedResponse_t *findCachedResponse(AsyncWebServerRequest *request);
+	bool sendCachedResponse(AsyncWebServerRequest *request);
+
+	// ----- Rate limit -----
+	ffRateRule_t rateRules[FF_RATE_LIMIT_RULES];			// Rate limit rules, from RateLimits key
+	uint8_t rateRuleCount = 0;								// Number of rate limit rules
+	ffRateBucket_t rateBuckets[FF_RATE_LIMIT_CLIENTS];		// Token buckets per client and rule
+	uint32_t rateLimited = 0;								// Requests rejected by rate limit
+	void parseRateLimits(const char *limits);
+	bool rateLimitRequest(AsyncWebServerRequest *request);
+
+	// ----- Wi-Fi scan -----
+	std::vector<ffWifiNetwork_t> wifiNetworks;				// Last scan results
+	unsigned long wifiScanInterval = FF_WIFI_SCAN_INTERVAL;	// Minimum interval between two scans (ms)
+	unsigned long wifiScanStart = 0;						// Last scan start time (millis)
+	unsigned long wifiScanTime = 0;							// Last scan results time (millis)
+	bool wifiScanRequested = false;							// A scan has been requested
+	bool wifiScanRunning = false;							// A scan is running
+	void serviceWifiScan(void);
+	void send_wifi_scan_json(AsyncWebServerRequest *request);
+
+	// ----- File system index -----
+	std::vector<ffFileIndex_t> fileIndex;					// Indexed files, sorted by hash
+	uint8_t getContentTypeId(const String &filename);
+	ffFileIndex_t *findFileIndex(const String &path);
+	ffFileIndex_t *insertFileIndex(const String &path);
+	ffFileMiss_t fileMisses[FF_FILE_MISS_CACHE];			// Paths recently searched without success
+	uint8_t fileMissNext = 0;								// Next fileMisses entry to use
+	bool recentFileMiss(const String &path);
+	void setFileMiss(const String &path, const bool found);
+	void addFileIndex(const String &path, const size_t size);
+	void addFolderIndex(const String &folder);
+	void buildFileIndex(void);
+	void updateFileIndex(String path);
+	bool sendFileRange(AsyncWebServerRequest *request, File &file, const String &path, const String &contentType, const char *etag);
+	#ifdef FF_EMBED_ASSETS
+		bool sendEmbeddedAsset(const String &path, AsyncWebServerRequest *request);
+	#endif
+	bool readUserConfigFile(void);
+	bool writeUserConfigFile(void);
+	uint32_t configLoadPeakHeap = 0;						// Peak heap used while parsing a configuration file (sampled at each read buffer refill)
+	void updateConfigLoadHeap(uint32_t heapBefore, uint32_t minFreeHeap);
+	String binaryConfigName(const char *fileName);
+	bool isConfigFile(const String &path);
+	bool configFileExists(const char *fileName);
+	void removeConfigFile(const char *fileName);
+	bool readConfigFile(const char *fileName, JsonDocument &jsonDoc, const JsonDocument *filter);
+	bool writeConfigFile(const char *fileName, const JsonDocument &jsonDoc);
+	unsigned long benchmarkConfigParse(const char *fileName, const bool binary, size_t &fileSize);
+	void benchmarkConfigFormats(void);
+
 	// ----- Web server -----
 	void percentDecode(char *src);
 	void loadConfig(void);
@@ -338,6 +915,7 @@ protected:
 	uint8_t mapRSSItoDomoticz(void);
 	uint8_t mapVccToDomoticz(void);
 	void handleFileList(AsyncWebServerRequest *request);
+	void handleFileSystemInfo(AsyncWebServerRequest *request);
 	bool handleFileRead(String path, AsyncWebServerRequest *request);
 	void handleFileCreate(AsyncWebServerRequest *request);
 	void handleFileDelete(AsyncWebServerRequest *request);
@@ -357,6 +935,7 @@ protected:
 	void setUpdateMD5(AsyncWebServerRequest *request);
 	void updateFirmware(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final);
 	void handle_rest_config(AsyncWebServerRequest *request);
+	void handle_rest_config_bundle(AsyncWebServerRequest *request);
 	void post_rest_config(AsyncWebServerRequest *request);
 	unsigned char h2int(char c);
 	boolean checkRange(String Value);
@@ -0,0 +1,74 @@
+/*!
+
+	Typed builtin configuration schema
+
+	Generated by makeschema.py from built-in keys - Don't edit!
+
+*/
+
+#ifndef _FF_BUILTIN_CONFIG_SCHEMA_h
+#define _FF_BUILTIN_CONFIG_SCHEMA_h
+
+#include <stddef.h>
+#include <FF_WebServer.hpp>
+
+// Configuration values
+typedef struct {
+	char MQTTClientID[64];
+	char MQTTUser[64];
+	char MQTTPass[64];
+	char MQTTTopic[128];
+	char MQTTCommandTopic[128];
+	char MQTTHost[64];
+	int MQTTPort;
+	int MQTTInterval;
+	char SyslogServer[64];
+	int SyslogPort;
+	char RateLimits[128];
+} ffBuiltinConfig_t;
+
+// Index of each key in FF_BUILTIN_CONFIG_KEYS
+enum {
+	FF_BUILTIN_CONFIG_MQTTClientID,
+	FF_BUILTIN_CONFIG_MQTTUser,
+	FF_BUILTIN_CONFIG_MQTTPass,
+	FF_BUILTIN_CONFIG_MQTTTopic,
+	FF_BUILTIN_CONFIG_MQTTCommandTopic,
+	FF_BUILTIN_CONFIG_MQTTHost,
+	FF_BUILTIN_CONFIG_MQTTPort,
+	FF_BUILTIN_CONFIG_MQTTInterval,
+	FF_BUILTIN_CONFIG_SyslogServer,
+	FF_BUILTIN_CONFIG_SyslogPort,
+	FF_BUILTIN_CONFIG_RateLimits,
+	FF_BUILTIN_CONFIG_COUNT
+};
+
+// Keys description
+static constexpr ffConfigKey_t FF_BUILTIN_CONFIG_KEYS[] = {
+	{"MQTTClientID", 0xaeb997d1UL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, MQTTClientID), sizeof(((ffBuiltinConfig_t*) 0)->MQTTClientID)},
+	{"MQTTUser", 0xf6522bb8UL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, MQTTUser), sizeof(((ffBuiltinConfig_t*) 0)->MQTTUser)},
+	{"MQTTPass", 0x6cf53e7eUL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, MQTTPass), sizeof(((ffBuiltinConfig_t*) 0)->MQTTPass)},
+	{"MQTTTopic", 0x94698326UL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, MQTTTopic), sizeof(((ffBuiltinConfig_t*) 0)->MQTTTopic)},
+	{"MQTTCommandTopic", 0x3cadd417UL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, MQTTCommandTopic), sizeof(((ffBuiltinConfig_t*) 0)->MQTTCommandTopic)},
+	{"MQTTHost", 0x2270e985UL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, MQTTHost), sizeof(((ffBuiltinConfig_t*) 0)->MQTTHost)},
+	{"MQTTPort", 0x62871204UL, FF_CONFIG_INT, offsetof(ffBuiltinConfig_t, MQTTPort), sizeof(((ffBuiltinConfig_t*) 0)->MQTTPort)},
+	{"MQTTInterval", 0x760639b2UL, FF_CONFIG_INT, offsetof(ffBuiltinConfig_t, MQTTInterval), sizeof(((ffBuiltinConfig_t*) 0)->MQTTInterval)},
+	{"SyslogServer", 0xf360a03fUL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, SyslogServer), sizeof(((ffBuiltinConfig_t*) 0)->SyslogServer)},
+	{"SyslogPort", 0x0b855197UL, FF_CONFIG_INT, offsetof(ffBuiltinConfig_t, SyslogPort), sizeof(((ffBuiltinConfig_t*) 0)->SyslogPort)},
+	{"RateLimits", 0xc37a6c23UL, FF_CONFIG_STRING, offsetof(ffBuiltinConfig_t, RateLimits), sizeof(((ffBuiltinConfig_t*) 0)->RateLimits)},
+};
+
+// Check that hashes are still in line with ffConfigHash()
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTClientID].hash == ffConfigHash("MQTTClientID"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTUser].hash == ffConfigHash("MQTTUser"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTPass].hash == ffConfigHash("MQTTPass"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTTopic].hash == ffConfigHash("MQTTTopic"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTCommandTopic].hash == ffConfigHash("MQTTCommandTopic"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTHost].hash == ffConfigHash("MQTTHost"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTPort].hash == ffConfigHash("MQTTPort"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_MQTTInterval].hash == ffConfigHash("MQTTInterval"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_SyslogServer].hash == ffConfigHash("SyslogServer"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_SyslogPort].hash == ffConfigHash("SyslogPort"), "Run makeschema.py again");
+static_assert(FF_BUILTIN_CONFIG_KEYS[FF_BUILTIN_CONFIG_RateLimits].hash == ffConfigHash("RateLimits"), "Run makeschema.py again");
+
+#endif // _FF_BUILTIN_CONFIG_SCHEMA_h
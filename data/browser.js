@@ -1,46 +1,31 @@
 /*jshint esversion: 6 */
 var syncLoader = (function() {
-    var jsFiles = [];
-    var cssFiles = [];
     var head = document.getElementsByTagName('head')[0];
 
-    var loadCssFiles = function(count) {
-        count = count || 0;
-
+    // Server closes connection after each answer, so all files are requested at once
+    //  (over parallel connections) instead of one after the other.
+    //  Dynamic scripts with async = false are still executed in given order.
+    var loadFile = function(file) {
         return new Promise(function (resolve, reject) {
-            var link = document.createElement("link");
-            link.rel = "stylesheet";
-            link.type = "text/css";
-            link.href = cssFiles[count];
-            link.onload = function () {
-                resolve();
-            };
-            link.onerror = function () {
-                reject(Error());
-            };
-            head.appendChild(link);
-        }).then(() => {
-            return ++count === cssFiles.length ? true : loadCssFiles(count);
-        });
-
-    };
-
-    var loadScriptFiles = function(count) {
-        count = count || 0;
-
-        return new Promise(function (resolve, reject) {
-            var script = document.createElement('script');
-            script.type = 'text/javascript';
-            script.src = jsFiles[count];
-            script.onload = function () {
+            var element;
+            if (endsWith(file, ".css")) {
+                element = document.createElement("link");
+                element.rel = "stylesheet";
+                element.type = "text/css";
+                element.href = file;
+            } else {
+                element = document.createElement('script');
+                element.type = 'text/javascript';
+                element.async = false;
+                element.src = file;
+            }
+            element.onload = function () {
                 resolve();
             };
-            script.onerror = function () {
+            element.onerror = function () {
                 reject(Error());
             };
-            head.appendChild(script);
-        }).then(() => {
-            return ++count === jsFiles.length ? true : loadScriptFiles(count);
+            head.appendChild(element);
         });
     };
 
@@ -51,16 +36,13 @@ var syncLoader = (function() {
     };
 
     var loadFiles = function(files) {
-        return new Promise(function(resolve, reject) {
-            for (var i = 0; i < files.length; ++i) {
-                if (endsWith(files[i], ".css")) {
-                    cssFiles.push(files[i]);
-                } else if (endsWith(files[i], ".js")) {
-                    jsFiles.push(files[i]);
-                }
+        var loads = [];
+        for (var i = 0; i < files.length; ++i) {
+            if (endsWith(files[i], ".css") || endsWith(files[i], ".js")) {
+                loads.push(loadFile(files[i]));
             }
-            loadScriptFiles().then(() => loadCssFiles()).then(() => resolve());
-        });
+        }
+        return Promise.all(loads).then(() => true);
     };
 
     return {'loadFiles': loadFiles};
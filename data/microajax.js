@@ -37,21 +37,24 @@ function microAjax(B,A){
     }
 }
 
-function setValues(url)
+function applyValues(text)
 {
-	microAjax(url, function (res) {
-	    res.split(String.fromCharCode(10)).forEach(
-            function (entry) {
-		        fields = entry.split("|");
-		        if(fields[2] == "input") {
-				    document.getElementById(fields[0]).value = fields[1];
-		        }
-		        else if(fields[2] == "div") {
-				    document.getElementById(fields[0]).innerHTML  = fields[1];
-		        } else if(fields[2] == "chk") {
-				    document.getElementById(fields[0]).checked  = fields[1];
-		        }
+    text.split(String.fromCharCode(10)).forEach(
+        function (entry) {
+            fields = entry.split("|");
+            if(fields[2] == "input") {
+                document.getElementById(fields[0]).value = fields[1];
+            }
+            else if(fields[2] == "div") {
+                document.getElementById(fields[0]).innerHTML  = fields[1];
+            } else if(fields[2] == "chk") {
+                document.getElementById(fields[0]).checked  = fields[1];
             }
-        );
-	});
-}
\ No newline at end of file
+        }
+    );
+}
+
+function setValues(url)
+{
+	microAjax(url, applyValues);
+}
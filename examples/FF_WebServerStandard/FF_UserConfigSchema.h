@@ -0,0 +1,94 @@
+/*!
+
+	Typed user configuration schema
+
+	Generated by makeschema.py from userconfigui.json and built-in keys - Don't edit!
+
+*/
+
+#ifndef _FF_USER_CONFIG_SCHEMA_h
+#define _FF_USER_CONFIG_SCHEMA_h
+
+#include <stddef.h>
+#include <FF_WebServer.hpp>
+
+// Configuration values
+typedef struct {
+	char MQTTClientID[64];
+	char MQTTUser[64];
+	char MQTTPass[64];
+	char MQTTTopic[128];
+	char MQTTCommandTopic[128];
+	char MQTTHost[64];
+	int MQTTPort;
+	int MQTTInterval;
+	char SyslogServer[64];
+	int SyslogPort;
+	char RateLimits[128];
+	char freeString[64];
+	char restrictedString[11];
+	bool checkboxValue;
+	int numberValue;
+	char selectorValue[9];
+} ffUserConfig_t;
+
+// Index of each key in FF_USER_CONFIG_KEYS
+enum {
+	FF_USER_CONFIG_MQTTClientID,
+	FF_USER_CONFIG_MQTTUser,
+	FF_USER_CONFIG_MQTTPass,
+	FF_USER_CONFIG_MQTTTopic,
+	FF_USER_CONFIG_MQTTCommandTopic,
+	FF_USER_CONFIG_MQTTHost,
+	FF_USER_CONFIG_MQTTPort,
+	FF_USER_CONFIG_MQTTInterval,
+	FF_USER_CONFIG_SyslogServer,
+	FF_USER_CONFIG_SyslogPort,
+	FF_USER_CONFIG_RateLimits,
+	FF_USER_CONFIG_freeString,
+	FF_USER_CONFIG_restrictedString,
+	FF_USER_CONFIG_checkboxValue,
+	FF_USER_CONFIG_numberValue,
+	FF_USER_CONFIG_selectorValue,
+	FF_USER_CONFIG_COUNT
+};
+
+// Keys description
+static constexpr ffConfigKey_t FF_USER_CONFIG_KEYS[] = {
+	{"MQTTClientID", 0xaeb997d1UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, MQTTClientID), sizeof(((ffUserConfig_t*) 0)->MQTTClientID)},
+	{"MQTTUser", 0xf6522bb8UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, MQTTUser), sizeof(((ffUserConfig_t*) 0)->MQTTUser)},
+	{"MQTTPass", 0x6cf53e7eUL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, MQTTPass), sizeof(((ffUserConfig_t*) 0)->MQTTPass)},
+	{"MQTTTopic", 0x94698326UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, MQTTTopic), sizeof(((ffUserConfig_t*) 0)->MQTTTopic)},
+	{"MQTTCommandTopic", 0x3cadd417UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, MQTTCommandTopic), sizeof(((ffUserConfig_t*) 0)->MQTTCommandTopic)},
+	{"MQTTHost", 0x2270e985UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, MQTTHost), sizeof(((ffUserConfig_t*) 0)->MQTTHost)},
+	{"MQTTPort", 0x62871204UL, FF_CONFIG_INT, offsetof(ffUserConfig_t, MQTTPort), sizeof(((ffUserConfig_t*) 0)->MQTTPort)},
+	{"MQTTInterval", 0x760639b2UL, FF_CONFIG_INT, offsetof(ffUserConfig_t, MQTTInterval), sizeof(((ffUserConfig_t*) 0)->MQTTInterval)},
+	{"SyslogServer", 0xf360a03fUL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, SyslogServer), sizeof(((ffUserConfig_t*) 0)->SyslogServer)},
+	{"SyslogPort", 0x0b855197UL, FF_CONFIG_INT, offsetof(ffUserConfig_t, SyslogPort), sizeof(((ffUserConfig_t*) 0)->SyslogPort)},
+	{"RateLimits", 0xc37a6c23UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, RateLimits), sizeof(((ffUserConfig_t*) 0)->RateLimits)},
+	{"freeString", 0x9ba0515eUL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, freeString), sizeof(((ffUserConfig_t*) 0)->freeString)},
+	{"restrictedString", 0x24f1f50dUL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, restrictedString), sizeof(((ffUserConfig_t*) 0)->restrictedString)},
+	{"checkboxValue", 0x6c8b4049UL, FF_CONFIG_BOOL, offsetof(ffUserConfig_t, checkboxValue), sizeof(((ffUserConfig_t*) 0)->checkboxValue)},
+	{"numberValue", 0x071dce91UL, FF_CONFIG_INT, offsetof(ffUserConfig_t, numberValue), sizeof(((ffUserConfig_t*) 0)->numberValue)},
+	{"selectorValue", 0xbc642155UL, FF_CONFIG_STRING, offsetof(ffUserConfig_t, selectorValue), sizeof(((ffUserConfig_t*) 0)->selectorValue)},
+};
+
+// Check that hashes are still in line with ffConfigHash()
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTClientID].hash == ffConfigHash("MQTTClientID"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTUser].hash == ffConfigHash("MQTTUser"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTPass].hash == ffConfigHash("MQTTPass"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTTopic].hash == ffConfigHash("MQTTTopic"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTCommandTopic].hash == ffConfigHash("MQTTCommandTopic"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTHost].hash == ffConfigHash("MQTTHost"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTPort].hash == ffConfigHash("MQTTPort"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_MQTTInterval].hash == ffConfigHash("MQTTInterval"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_SyslogServer].hash == ffConfigHash("SyslogServer"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_SyslogPort].hash == ffConfigHash("SyslogPort"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_RateLimits].hash == ffConfigHash("RateLimits"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_freeString].hash == ffConfigHash("freeString"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_restrictedString].hash == ffConfigHash("restrictedString"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_checkboxValue].hash == ffConfigHash("checkboxValue"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_numberValue].hash == ffConfigHash("numberValue"), "Run makeschema.py again");
+static_assert(FF_USER_CONFIG_KEYS[FF_USER_CONFIG_selectorValue].hash == ffConfigHash("selectorValue"), "Run makeschema.py again");
+
+#endif // _FF_USER_CONFIG_SCHEMA_h
@@ -20,21 +20,20 @@
 
 #define VERSION "1.0.0"										// Version of this code
 #include <FF_WebServer.h>									// Defines associated to FF_WebServer class
+#include "FF_UserConfigSchema.h"							// Typed user configuration (generated by makeschema.py from userconfigui.json)
 
 //	User internal data
 //		Declare here user's data needed by user's code
 
 int myValue;
 char myString[] = "Hello!";
+int mySeconds = -1;											// myValue in seconds, bound to /rest/values, /json/values, MQTT and index.htm
+char headerText[100];										// Header of index.htm, pushed to index.htm
 
-//	User configuration data (should be in line with userconfigui.json)
-//		Declare here user's configuration data needed by user's code
+//	User configuration data (generated from userconfigui.json by makeschema.py)
+//		Use userConfig.<name> to access values (i.e. userConfig.numberValue)
 
-String freeString;
-String restrictedString;
-int checkboxValue;
-int numberValue;
-String selectorValue;
+ffUserConfig_t userConfig;
 
 // Declare here used callbacks
 static CONFIG_CHANGED_CALLBACK(onConfigChangedCallback);
@@ -49,12 +48,19 @@ static WIFI_DISCONNECT_CALLBACK(onWifiDisconnectCallback);
 static WIFI_GOT_IP_CALLBACK(onWifiGotIpCallback);
 static MQTT_MESSAGE_CALLBACK(onMqttMessageCallback);
 
+// Compose header displayed at top of index.htm: device name, versions and uptime
+static void composeHeader(char *buffer, const size_t size) {
+	snprintf_P(buffer, size, PSTR("%s V%s/%s, up since %s"),
+		FF_WebServer.getDeviceName().c_str(), VERSION, FF_WebServer.getWebServerVersion(), NTP.getUptimeString().c_str());
+}
+
 // Here are the callbacks code
 
 /*!
 
 	This routine is called when permanent configuration data has been changed.
 		User should call FF_WebServer.load_user_config to get values defined in userconfigui.json.
+		Using key table generated by makeschema.py, all values are loaded at once, with the right type.
 		Values in config.json may also be get here.
 
 	\param	none
@@ -64,11 +70,7 @@ static MQTT_MESSAGE_CALLBACK(onMqttMessageCallback);
 
 CONFIG_CHANGED_CALLBACK(onConfigChangedCallback) {
 	trace_info_P("Entering %s", __func__);
-	FF_WebServer.load_user_config("freeString", freeString);
-	FF_WebServer.load_user_config("restrictedString", restrictedString);
-	FF_WebServer.load_user_config("checkboxValue", checkboxValue);
-	FF_WebServer.load_user_config("numberValue", numberValue);
-	FF_WebServer.load_user_config("selectorValue", selectorValue);
+	FF_WebServer.load_user_config(FF_USER_CONFIG_KEYS, FF_USER_CONFIG_COUNT, &userConfig);
 }
 
 /*!
@@ -108,10 +110,11 @@ DEBUG_COMMAND_CALLBACK(onDebugCommandCallback) {
 		// -- Add here your own user variables to print
 		trace_info_P("myValue=%d", myValue);
 		trace_info_P("myString=%s", myString);
-		trace_info_P("restrictedString=%s", restrictedString.c_str());
-		trace_info_P("checkboxValue=%d", checkboxValue);
-		trace_info_P("numberValue=%d", numberValue);
-		trace_info_P("selectorValue=%s", selectorValue.c_str());
+		trace_info_P("freeString=%s", userConfig.freeString);
+		trace_info_P("restrictedString=%s", userConfig.restrictedString);
+		trace_info_P("checkboxValue=%d", userConfig.checkboxValue);
+		trace_info_P("numberValue=%d", userConfig.numberValue);
+		trace_info_P("selectorValue=%s", userConfig.selectorValue);
 		// -----------
 		return true;
 	// Put here your own debug commands
@@ -130,44 +133,17 @@ DEBUG_COMMAND_CALLBACK(onDebugCommandCallback) {
 
 	If no valid command can be found, should return false, to let server returning an error message.
 
-	\note	Note that minimal implementation should support at least /rest/values, which is requested by index.html
-		to get list of values to display on root main page. This should at least contain "header" topic,
-		displayed at top of page. Standard header contains device name, versions of user code, FF_WebServer template
-		followed by device uptime. You may send something different.
-		It should then contain user's values to be displayed by index_user.html file.
+	\note	/rest/values, requested by index.html to get list of values to display on root main page, is answered
+		by FF_WebServer with values bound by bindValue() (see setup), after a "header" topic displayed at top of page
+		(device name, versions of user code and FF_WebServer template, followed by device uptime).
+		Answer it here only if you want to send something different.
 
 	\param[in]	request: AsyncWebServerRequest structure describing user's request
 	\return	true for valid answered by request->send command, false else
 
 */
 REST_COMMAND_CALLBACK(onRestCommandCallback) {
-	if (request->url() == "/rest/values") {
-		char tempBuffer[500];
-		tempBuffer[0] = 0;
-
-		snprintf_P(tempBuffer, sizeof(tempBuffer),
-			PSTR(
-				// -- Put header composition
-				"header|%s V%s/%s, up since %s|div\n"
-				// -- Put here user variables to be available in index_user.html
-				"myValue|%d|div\n"
-				"myString|%s|div\n"
-				// -----------------
-				)
-			// -- Put here values of header line
-			,FF_WebServer.getDeviceName().c_str()
-			,VERSION, FF_WebServer.getWebServerVersion()
-			,NTP.getUptimeString().c_str()
-			// -- Put here values in index_user.html
-			,myValue/1000
-			,myString
-			// -----------------
-			);
-		request->send(200, "text/plain", tempBuffer);
-		return true;
-	}
-
-	trace_info_P("Entering %s", __func__);					// Put trace here as /rest/value is called every second0
+	trace_info_P("Entering %s", __func__);
 	if (request->url() == "/rest/err400") {
 		request->send(400, "text/plain", "Error 400 requested by user");
 		return true;
@@ -183,6 +159,8 @@ REST_COMMAND_CALLBACK(onRestCommandCallback) {
 
 		If no valid command can be found, should return false, to let template code returning an error message.
 
+		/json/values is answered by FF_WebServer with values bound by bindValue() (see setup), when not answered here.
+
 	\param[in]	request: AsyncWebServerRequest structure describing user's request
 	\return	true for valid answered by request->send command, false else
 
@@ -190,22 +168,6 @@ REST_COMMAND_CALLBACK(onRestCommandCallback) {
 
 JSON_COMMAND_CALLBACK(onJsonCommandCallback) {
 	trace_info_P("Entering %s", __func__);
-	if (request->url() == "/json/values") {
-		char tempBuffer[100];
-		tempBuffer[0] = 0;
-
-		snprintf_P(tempBuffer, sizeof(tempBuffer),
-			PSTR("{"
-					"\"myValue\":%d"
-					",\"myString\":\"%s\""
-				 "}")
-			,myValue/1000
-			,myString
-		);
-		request->send(200, "text/json", tempBuffer);
-		return true;
-	}
-
 	if (request->url() == "/json/values2") {
 		DynamicJsonDocument jsonDoc(250);
 		jsonDoc["myValue"] = myValue/1000;
@@ -220,6 +182,27 @@ JSON_COMMAND_CALLBACK(onJsonCommandCallback) {
 	return false;
 }
 
+/*!
+
+	This routine is called for /rest/myvalue/{divider:int} requests (see route() in setup)
+		Path parameters are read from params, without having to parse request->url().
+
+	\param[in]	request: AsyncWebServerRequest structure describing user's request
+	\param[in]	params: path parameters (here divider, an integer)
+	\return	None
+
+*/
+
+ROUTE_CALLBACK(onMyValueRoute) {
+	long divider = params.getInt("divider", 1);
+	// Send answers through FF_WebServer, to have them counted in /admin/metrics
+	if (!divider) {
+		FF_WebServer.sendResponse(request, 400, "text/plain", "Divider can't be 0");
+		return;
+	}
+	FF_WebServer.sendResponse(request, 200, "text/plain", String(myValue / divider));
+}
+
 /*!
 
 	This routine analyze and execute commands sent through POST command
@@ -348,6 +331,15 @@ void setup() {
 	FF_WebServer.setWifiGotIpCallback(&onWifiGotIpCallback);
 	FF_WebServer.setMqttConnectCallback(&onMqttConnectCallback);
 	FF_WebServer.setMqttMessageCallback(&onMqttMessageCallback);
+	// Register a route with a path parameter (checked before REST command callback)
+	FF_WebServer.route("/rest/myvalue/{divider:int}", HTTP_GET, FF_AUTH_NONE, &onMyValueRoute);
+	// Send these variables in /rest/values and /json/values, publish them on MQTT and push their changes to index.htm
+	FF_WebServer.bindValue("myValue", &mySeconds, FF_BIND_REST | FF_BIND_JSON | FF_BIND_MQTT | FF_BIND_PUSH);
+	FF_WebServer.bindValue("myString", myString, FF_BIND_REST | FF_BIND_JSON | FF_BIND_MQTT | FF_BIND_PUSH);
+	// Header is already sent in /rest/values, push it as it contains uptime
+	FF_WebServer.bindValue("header", headerText, FF_BIND_PUSH);
+	// Answer /rest/values and /json/values polls from cache during 500 ms
+	FF_WebServer.setResponseCache("/rest/values", 500).setResponseCache("/json/values", 500);
 }
 
 //	This is the main loop.
@@ -355,6 +347,12 @@ void setup() {
 void loop() {
 	// User part of loop
 	myValue = millis();
+	// Update bound values, pushed by FF_WebServer.handle() when they change
+	if (myValue/1000 != mySeconds) {
+		mySeconds = myValue/1000;
+		// Header contains uptime, update it too, as index.htm reads /rest/values only every 30 s when values are pushed
+		composeHeader(headerText, sizeof(headerText));
+	}
 	// Manage Web Server
 	FF_WebServer.handle();
 }
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+
+	makeassets.py
+
+	Generates a C++ header embedding standard web pages from data/ folder, gzipped, in PROGMEM.
+
+	When FF_EMBED_ASSETS is defined, FF_WebServer sends these files directly from flash
+		(with Content-Encoding: gzip and a precomputed ETag) if they're not found on LittleFS.
+		A LittleFS file with the same name is still sent instead of embedded one.
+
+	Text files (.htm, .html, .css, .js, .json) are lightly minified before compression:
+		leading and trailing spaces and empty lines are removed (line breaks are kept, to not break javascript).
+
+	Usage:
+		python makeassets.py [--data data] [--output FF_WebServerAssets.h] [--exclude index_user.html] [--no-minify]
+
+	Can also be used as a PlatformIO pre script (extra_scripts = pre:<path>/makeassets.py).
+		In this case, FF_WebServer data folder is read and FF_WebServerAssets.h is written in FF_WebServer folder.
+
+	Written and maintained by Flying Domotic (https://github.com/FlyingDomotic/FF_WebServer)
+
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import sys
+
+# Files not to embed by default (user's ones)
+DEFAULT_EXCLUDE = ["index_user.html", "userconfigui.json", "userconfig.json", "config.json", "secret.json"]
+MINIFY_EXTENSIONS = [".htm", ".html", ".css", ".js", ".json"]
+
+# Remove indentation, trailing spaces and empty lines of a text file
+def minify(content):
+	lines = [line.strip() for line in content.decode("utf-8").splitlines()]
+	return "\n".join([line for line in lines if line]).encode("utf-8")
+
+# Return a C identifier from a file name
+def identifier(fileName):
+	return "ffAsset_" + "".join([c if c.isalnum() else "_" for c in fileName])
+
+# Load, minify and compress files of a folder. Returns a list of (name, gzipped data)
+def loadAssets(dataFolder, exclude, doMinify):
+	assets = []
+	for fileName in sorted(os.listdir(dataFolder)):
+		fullName = os.path.join(dataFolder, fileName)
+		if not os.path.isfile(fullName) or fileName in exclude or fileName.endswith(".gz"):
+			continue
+		with open(fullName, "rb") as inFile:
+			content = inFile.read()
+		if doMinify and os.path.splitext(fileName)[1] in MINIFY_EXTENSIONS:
+			content = minify(content)
+		# mtime=0 gives same result for same content
+		assets.append((fileName, gzip.compress(content, compresslevel=9, mtime=0), len(content)))
+	return assets
+
+# Generate header content
+def makeHeader(assets, source):
+	lines = []
+	lines.append("/*!")
+	lines.append("")
+	lines.append("\tEmbedded web pages (gzipped)")
+	lines.append("")
+	lines.append("\tGenerated by makeassets.py from %s - Don't edit!" % source)
+	lines.append("")
+	lines.append("*/")
+	lines.append("")
+	lines.append("#ifndef _FF_WEBSERVER_ASSETS_h")
+	lines.append("#define _FF_WEBSERVER_ASSETS_h")
+	lines.append("")
+	lines.append("#include <FF_WebServer.hpp>")
+	lines.append("")
+	for fileName, data, size in assets:
+		name = identifier(fileName)
+		lines.append("// %s: %d bytes, %d gzipped" % (fileName, size, len(data)))
+		lines.append("static const char %s_path[] PROGMEM = \"/%s\";" % (name, fileName))
+		lines.append("static const char %s_etag[] PROGMEM = \"\\\"e-%s\\\"\";" % (name, hashlib.md5(data).hexdigest()[:16]))
+		lines.append("static const uint8_t %s_data[] PROGMEM = {" % name)
+		for i in range(0, len(data), 16):
+			lines.append("\t" + ", ".join(["0x%02x" % b for b in data[i:i + 16]]) + ",")
+		lines.append("};")
+		lines.append("")
+	lines.append("// Embedded files description")
+	lines.append("static const ffEmbeddedAsset_t FF_EMBEDDED_ASSETS[] PROGMEM = {")
+	for fileName, data, size in assets:
+		name = identifier(fileName)
+		lines.append("\t{%s_path, %s_data, %d, %s_etag}," % (name, name, len(data), name))
+	lines.append("};")
+	lines.append("#define FF_EMBEDDED_ASSET_COUNT %d" % len(assets))
+	lines.append("")
+	lines.append("#endif // _FF_WEBSERVER_ASSETS_h")
+	lines.append("")
+	return "\n".join(lines)
+
+# Generate header, writing it only if changed (to avoid useless recompilation)
+def generate(dataFolder, outputFile, exclude, doMinify):
+	assets = loadAssets(dataFolder, exclude, doMinify)
+	content = makeHeader(assets, os.path.basename(os.path.normpath(dataFolder)))
+	if os.path.exists(outputFile):
+		with open(outputFile, "rt", encoding="utf-8") as inFile:
+			if inFile.read() == content:
+				return
+	with open(outputFile, "wt", encoding="utf-8", newline="\n") as outFile:
+		outFile.write(content)
+	print("makeassets: %s written (%d files, %d bytes gzipped)" % (outputFile, len(assets), sum([len(a[1]) for a in assets])))
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description="Embed data folder files, gzipped, in a PROGMEM header")
+	parser.add_argument("--data", default="data", help="folder containing files to embed")
+	parser.add_argument("--output", default="FF_WebServerAssets.h", help="header file to write")
+	parser.add_argument("--exclude", action="append", default=[], help="file name not to embed (can be repeated)")
+	parser.add_argument("--no-minify", action="store_true", help="don't minify text files")
+	args = parser.parse_args()
+	if not os.path.isdir(args.data):
+		print("makeassets: can't find %s folder" % args.data)
+		sys.exit(2)
+	generate(args.data, args.output, DEFAULT_EXCLUDE + args.exclude, not args.no_minify)
+else:
+	# Running as a PlatformIO (SCons) pre script
+	import inspect
+	Import("env")	# noqa: F821
+	# __file__ is not defined by SCons, get script folder from current frame
+	libraryDir = os.path.dirname(os.path.abspath(inspect.getfile(inspect.currentframe())))
+	generate(os.path.join(libraryDir, "data"), os.path.join(libraryDir, "FF_WebServerAssets.h"), DEFAULT_EXCLUDE, True)
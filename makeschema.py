@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+
+	makeschema.py
+
+	Generates a C++ header describing user configuration keys, to access them in a typed way.
+
+	Input is userconfigui.json (optional), to which built-in keys read by FF_WebServer are added.
+	Output header contains:
+		- a structure holding one typed field per key,
+		- an index enumeration,
+		- a key table with precomputed hashes, used by load_user_config/save_user_config.
+
+	Type is deduced from userconfigui.json entity:
+		- "attributes": {"type": "checkbox"} gives a bool,
+		- "attributes": {"type": "number"} gives an int (or a float if min, max or step are not integers),
+		- "tag": "select" gives a string sized for the longest option,
+		- anything else gives a string, sized with "maxlength" attribute if given, else 64 chars.
+	An optional "ctype" entity item forces type (string, int, long, bool, float or ip),
+		and an optional "csize" item forces string size.
+
+	Usage:
+		python makeschema.py [--ui data/userconfigui.json] [--output FF_UserConfigSchema.h] [--name User] [--builtin-only]
+
+	Can also be used as a PlatformIO pre script (extra_scripts = pre:<path>/makeschema.py).
+		In this case, data/userconfigui.json is read and FF_UserConfigSchema.h is written in project source folder.
+
+	Written and maintained by Flying Domotic (https://github.com/FlyingDomotic/FF_WebServer)
+
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+DEFAULT_STRING_SIZE = 64
+
+# Keys read by FF_WebServer in loadConfig() (name, type, size)
+BUILTIN_KEYS = [
+	("MQTTClientID", "string", 64),
+	("MQTTUser", "string", 64),
+	("MQTTPass", "string", 64),
+	("MQTTTopic", "string", 128),
+	("MQTTCommandTopic", "string", 128),
+	("MQTTHost", "string", 64),
+	("MQTTPort", "int", 0),
+	("MQTTInterval", "int", 0),
+	("SyslogServer", "string", 64),
+	("SyslogPort", "int", 0),
+	("RateLimits", "string", 128),
+]
+
+C_TYPES = {
+	"string": ("char", "FF_CONFIG_STRING"),
+	"int": ("int", "FF_CONFIG_INT"),
+	"long": ("long", "FF_CONFIG_LONG"),
+	"bool": ("bool", "FF_CONFIG_BOOL"),
+	"float": ("float", "FF_CONFIG_FLOAT"),
+	"ip": ("uint32_t", "FF_CONFIG_IP"),
+}
+
+# Compute FNV-1a hash of a key name (same as ffConfigHash())
+def keyHash(name):
+	hash = 2166136261
+	for c in name.encode("utf-8"):
+		hash = ((hash ^ c) * 16777619) & 0xFFFFFFFF
+	return hash
+
+# Check if a value is not an integer
+def isDecimal(value):
+	if value is None:
+		return False
+	try:
+		return float(value) != int(float(value))
+	except ValueError:
+		return False
+
+# Return (type, size) of an userconfigui.json entity
+def entityType(entity):
+	attributes = entity.get("attributes", {})
+	if "ctype" in entity:
+		keyType = entity["ctype"]
+		if keyType not in C_TYPES:
+			raise ValueError("Unknown ctype %s for %s" % (keyType, entity["name"]))
+		return keyType, int(entity.get("csize", DEFAULT_STRING_SIZE)) if keyType == "string" else 0
+	if attributes.get("type") == "checkbox":
+		return "bool", 0
+	if attributes.get("type") == "number":
+		if isDecimal(attributes.get("min")) or isDecimal(attributes.get("max")) or isDecimal(attributes.get("step")):
+			return "float", 0
+		return "int", 0
+	if entity.get("tag") == "select":
+		options = entity.get("options", [])
+		return "string", int(entity.get("csize", max([len(str(o)) for o in options] + [1]) + 1))
+	if "csize" in entity:
+		return "string", int(entity["csize"])
+	if "maxlength" in attributes:
+		return "string", int(attributes["maxlength"]) + 1
+	return "string", DEFAULT_STRING_SIZE
+
+# Load keys from userconfigui.json
+def loadUiKeys(fileName):
+	with open(fileName, "rt", encoding="utf-8") as inFile:
+		ui = json.load(inFile)
+	keys = []
+	for group in ui.get("groups", []):
+		for entity in group.get("entities", []):
+			keyType, size = entityType(entity)
+			keys.append((entity["name"], keyType, size))
+	return keys
+
+# Generate header content
+def makeHeader(keys, name, source):
+	structName = "ff%sConfig_t" % name
+	prefix = "FF_%s_CONFIG" % name.upper()
+	guard = "_FF_%s_CONFIG_SCHEMA_h" % name.upper()
+	lines = []
+	lines.append("/*!")
+	lines.append("")
+	lines.append("\tTyped %s configuration schema" % name.lower())
+	lines.append("")
+	lines.append("\tGenerated by makeschema.py from %s - Don't edit!" % source)
+	lines.append("")
+	lines.append("*/")
+	lines.append("")
+	lines.append("#ifndef %s" % guard)
+	lines.append("#define %s" % guard)
+	lines.append("")
+	lines.append("#include <stddef.h>")
+	lines.append("#include <FF_WebServer.hpp>")
+	lines.append("")
+	lines.append("// Configuration values")
+	lines.append("typedef struct {")
+	for keyName, keyType, size in keys:
+		cType = C_TYPES[keyType][0]
+		if keyType == "string":
+			lines.append("\t%s %s[%d];" % (cType, keyName, size))
+		else:
+			lines.append("\t%s %s;" % (cType, keyName))
+	lines.append("} %s;" % structName)
+	lines.append("")
+	lines.append("// Index of each key in %s_KEYS" % prefix)
+	lines.append("enum {")
+	for keyName, keyType, size in keys:
+		lines.append("\t%s_%s," % (prefix, keyName))
+	lines.append("\t%s_COUNT" % prefix)
+	lines.append("};")
+	lines.append("")
+	lines.append("// Keys description")
+	lines.append("static constexpr ffConfigKey_t %s_KEYS[] = {" % prefix)
+	for keyName, keyType, size in keys:
+		lines.append("\t{\"%s\", 0x%08xUL, %s, offsetof(%s, %s), sizeof(((%s*) 0)->%s)}," % (
+			keyName, keyHash(keyName), C_TYPES[keyType][1], structName, keyName, structName, keyName))
+	lines.append("};")
+	lines.append("")
+	lines.append("// Check that hashes are still in line with ffConfigHash()")
+	for keyName, keyType, size in keys:
+		lines.append("static_assert(%s_KEYS[%s_%s].hash == ffConfigHash(\"%s\"), \"Run makeschema.py again\");" % (prefix, prefix, keyName, keyName))
+	lines.append("")
+	lines.append("#endif // %s" % guard)
+	lines.append("")
+	return "\n".join(lines)
+
+# Generate header, writing it only if changed (to avoid useless recompilation)
+def generate(uiFile, outputFile, name, builtinOnly):
+	keys = list(BUILTIN_KEYS)
+	source = "built-in keys"
+	if not builtinOnly and uiFile and os.path.exists(uiFile):
+		for key in loadUiKeys(uiFile):
+			if key[0] in [k[0] for k in keys]:
+				raise ValueError("Key %s defined twice" % key[0])
+			keys.append(key)
+		source = "%s and built-in keys" % os.path.basename(uiFile)
+	for key in keys:
+		if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", key[0]):
+			raise ValueError("Key %s is not a valid C identifier" % key[0])
+	content = makeHeader(keys, name, source)
+	if os.path.exists(outputFile):
+		with open(outputFile, "rt", encoding="utf-8") as inFile:
+			if inFile.read() == content:
+				return
+	with open(outputFile, "wt", encoding="utf-8", newline="\n") as outFile:
+		outFile.write(content)
+	print("makeschema: %s written (%d keys)" % (outputFile, len(keys)))
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description="Generate typed configuration header from userconfigui.json")
+	parser.add_argument("--ui", default="data/userconfigui.json", help="userconfigui.json file to read")
+	parser.add_argument("--output", default="FF_UserConfigSchema.h", help="header file to write")
+	parser.add_argument("--name", default="User", help="name used in generated types (ff<name>Config_t)")
+	parser.add_argument("--builtin-only", action="store_true", help="only generate built-in keys")
+	args = parser.parse_args()
+	try:
+		generate(args.ui, args.output, args.name, args.builtin_only)
+	except (ValueError, KeyError) as error:
+		print("makeschema: %s" % error)
+		sys.exit(2)
+else:
+	# Running as a PlatformIO (SCons) pre script
+	Import("env")	# noqa: F821
+	projectDir = env.subst("$PROJECT_DIR")	# noqa: F821
+	generate(os.path.join(projectDir, "data", "userconfigui.json"), os.path.join(env.subst("$PROJECT_SRC_DIR"), "FF_UserConfigSchema.h"), "User", False)	# noqa: F821